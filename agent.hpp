@@ -1,14 +1,30 @@
 #pragma once
+#include "arena.hpp"
+#include "batch.hpp"
 #include "board.hpp"
 #include "random.hpp"
+#include "solver.hpp"
+#include "stats.hpp"
+#include "symmetry.hpp"
+#include "tt.hpp"
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cmath>
+#include <fstream>
+#include <functional>
+#include <limits>
 #include <memory>
+#include <string>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 class RandomAgent {
 public:
+  RandomAgent() = default;
+  explicit RandomAgent(uint64_t seed) : engine_(seed) {}
+
   size_t take_action(const Board &board, size_t bw) {
     return board.random_legal_move(bw, engine_);
   }
@@ -17,156 +33,724 @@ private:
   xorshift engine_{splitmix{}()};
 };
 
+struct MCTSConfig {
+  // number of search threads sharing one tree
+  size_t threads = 1;
+  // megabytes of node storage, split between the search tree and the
+  // buffer its reused subtree is copied into; a search filling the tree
+  // compacts it into that buffer, so the storage never grows past this
+  size_t memory = 1024;
+  // keep searching on the opponent's time after genmove
+  bool ponder = false;
+  // megabytes of transposition table, 0 disables it
+  size_t tt = 0;
+  // seed of the per-thread random engines
+  uint64_t seed = splitmix::default_seed;
+  // report each search on stderr
+  bool verbose = true;
+  // file to append the statistics of each search to as a JSON line
+  std::string log;
+  // playouts per leaf, run in lockstep batches of PlayoutBatch::lanes;
+  // 1 plays a single playout on a Board
+  size_t batch = 1;
+  // playout policy: each move is drawn among the legal points, the points
+  // open to both sides weighing this much against 1 for the others; 0
+  // plays the points open to both sides at the start of the playout
+  // first, then any legal point, uniformly
+  size_t shared_weight = 64;
+  // children open to selection at first under progressive widening, one
+  // more each time the visits of the node grow by 40% past 40; 0 opens
+  // all of them at once
+  size_t widening = 0;
+  // positions with at most this many points open to both sides are first
+  // given to the exact solver for half of the budget; 0 disables it
+  size_t solve = 16;
+};
+
 class MCTSAgent {
 private:
+  // positions with at most this many stones are checked for symmetries
+  const static constexpr size_t symmetry_stones = 10;
+
   class Node {
   public:
-    constexpr void init_bw(size_t bw) noexcept { bw_ = bw; }
+    // fields of the statistics, each an array over the children of a node
+    enum : size_t {
+      WINS,
+      VISITS,
+      RAVE_WINS,
+      RAVE_VISITS,
+      PROOF,
+      VIRTUAL_LOSS,
+      FIELDS
+    };
+    using stat_t = std::atomic<uint32_t>;
+    // proven outcomes for the player who made the move into a node
+    enum : uint32_t { UNPROVEN, WIN, LOSS };
+
+    // bw made the last move of the position with the given Zobrist hash;
+    // stats holds the FIELDS statistics of the root itself
+    void init_root(size_t bw, uint64_t hash, stat_t *stats) noexcept {
+      bw_ = static_cast<uint8_t>(bw);
+      key_ = bw == 0 ? hash : hash ^ TranspositionTable::side_key;
+      stats_ = stats;
+      stride_ = 1;
+      reset_stats();
+    }
     constexpr Node *get_parent() const noexcept { return parent_; };
-    constexpr bool has_children() const noexcept { return children_size_ > 0; }
-    template <class PRNG>
-    Node *select_child(PRNG &rng, size_t &bw, size_t &pos) {
-      float max_score = -1.f;
-      for (size_t i = 0; i < children_size_; ++i) {
-        auto &child = children_[i];
-        const float score = (child.rave_wins_ + child.wins_ +
-                             std::sqrt(log_visits_ * child.visits_) * 0.25f) /
-                            (child.rave_visits_ + child.visits_);
-        child.uct_score_ = score;
-        max_score = (score - max_score > 0.0001f) ? score : max_score;
-      }
-      Board::board_t max_children{};
-      for (size_t i = 0; i < children_size_; ++i) {
-        if ((children_[i].uct_score_ - max_score) > -0.0001f) {
-          max_children.set(i);
+    bool has_children() const noexcept {
+      return state_.load(std::memory_order_acquire) == EXPANDED;
+    }
+    // index of the child to descend to; with widening > 0, the children
+    // never selected are opened to selection progressively, by their RAVE
+    // value, starting with widening of them
+    template <class PRNG> size_t select_child(PRNG &rng, size_t widening) {
+      const auto relaxed = std::memory_order_relaxed;
+      const size_t size = children_size_;
+      stat_t *stats = child_stats_;
+      // snapshot of the statistics; pending simulations of other threads
+      // count as losses, proven wins are always taken and proven losses
+      // only when there is nothing else
+      alignas(32) std::array<float, simd_size> numerator, visits, denominator;
+      for (size_t i = 0; i < size; ++i) {
+        const uint32_t proof = stats[PROOF * size + i].load(relaxed);
+        if (proof != UNPROVEN) {
+          numerator[i] = proof == WIN ? 1e9f : -0.5f;
+          visits[i] = 0.f;
+          denominator[i] = 1.f;
+          continue;
         }
+        const auto v =
+            static_cast<float>(stats[VISITS * size + i].load(relaxed) +
+                               stats[VIRTUAL_LOSS * size + i].load(relaxed));
+        visits[i] = v;
+        numerator[i] =
+            static_cast<float>(stats[WINS * size + i].load(relaxed) +
+                               stats[RAVE_WINS * size + i].load(relaxed));
+        denominator[i] =
+            static_cast<float>(stats[RAVE_VISITS * size + i].load(relaxed)) +
+            v;
+      }
+      // padding up to the vector width scores -1
+      for (size_t i = size; i % 8 != 0; ++i) {
+        numerator[i] = -1.f;
+        visits[i] = 0.f;
+        denominator[i] = 1.f;
       }
-      size_t idx = Board::random_move_from_board(max_children, rng);
-      auto &child = children_[idx];
-      bw = child.bw_;
-      pos = child.pos_;
-      return &child;
+      const auto n = static_cast<float>(stat(VISITS).load(relaxed));
+      if (widening > 0 && size > widening) {
+        // one more child each time the visits grow by 40%, from 40 on
+        const size_t width =
+            widening + (n > 40.f ? static_cast<size_t>(std::log(n / 40.f) /
+                                                       std::log(1.4f))
+                                 : 0);
+        narrow(width, size, numerator, visits, denominator);
+      }
+      std::array<uint8_t, 81> ties;
+      const size_t ties_size = best_scores(std::log(n), size, numerator,
+                                           visits, denominator, ties);
+      const size_t index = ties[rng() % ties_size];
+      stats[VIRTUAL_LOSS * size + index].fetch_add(1, relaxed);
+      return index;
     }
-    bool expand(const Board &b) noexcept {
-      if (visits_ == 0 || is_leaf_) {
+    // the child selected at index, created on its first selection; nullptr
+    // when the arena is full, with the virtual loss of the selection undone
+    Node *get_child(size_t index, Arena &arena, size_t &nodes) noexcept {
+      auto &slot = children_[index];
+      Node *child = slot.load(std::memory_order_acquire);
+      if (child != nullptr) {
+        return child;
+      }
+      auto *created = arena.allocate<Node>(1);
+      if (created == nullptr) {
+        child_stats_[VIRTUAL_LOSS * children_size_ + index].fetch_sub(
+            1, std::memory_order_relaxed);
+        return nullptr;
+      }
+      const uint8_t cbw = 1 - bw_;
+      const size_t pos = moves_.select(index);
+      created->init(cbw, static_cast<uint8_t>(pos), this,
+                    key_ ^ Board::zobrist(cbw, pos) ^
+                        TranspositionTable::side_key,
+                    index);
+      // a thread losing the race leaves its node unused in the arena
+      if (!slot.compare_exchange_strong(child, created,
+                                        std::memory_order_acq_rel)) {
+        return child;
+      }
+      ++nodes;
+      return created;
+    }
+    bool expand(const Board &b, Arena &arena) noexcept {
+      // a proven node collapsed by the garbage collection stays a leaf
+      if (stat(VISITS).load(std::memory_order_relaxed) == 0 ||
+          stat(PROOF).load(std::memory_order_relaxed) != UNPROVEN) {
+        return false;
+      }
+      // only one thread expands a node; the others simulate from it
+      uint8_t state = UNEXPANDED;
+      if (!state_.compare_exchange_strong(state, EXPANDING,
+                                          std::memory_order_acquire)) {
         return false;
       }
-      auto moves(b.get_legal_moves(1 - bw_));
+      const uint8_t cbw = 1 - bw_;
+      auto moves(b.get_legal_moves(cbw));
+      // symmetric moves of an early root share one child; deeper nodes
+      // keep them all, so that the reply played is found when reusing
+      if (parent_ == nullptr && b.empty_count() + symmetry_stones >= 81) {
+        moves = symmetry::unique_moves(b, moves);
+      }
       const size_t size = moves.count();
       if (size == 0) {
-        is_leaf_ = true;
+        // the opponent has no move left
+        stat(PROOF).store(WIN, std::memory_order_relaxed);
+        state_.store(LEAF, std::memory_order_release);
+        return false;
+      }
+      // expand the statistics of the children, whose nodes are created on
+      // their first selection; a full arena keeps this node a leaf for now
+      if (!allocate_children(size, arena)) {
+        state_.store(UNEXPANDED, std::memory_order_release);
         return false;
       }
-      // expand children
-      children_size_ = size;
-      children_ = std::make_unique<Node[]>(size);
-      for (size_t i = 0, pos = moves._Find_first(); i < size;
-           ++i, pos = moves._Find_next(pos)) {
-        children_[i].init(1 - bw_, pos, this);
+      for (size_t i = 0; i < size; ++i) {
+        reset_stats(child_stats_ + i, size);
       }
+      children_size_ = static_cast<uint8_t>(size);
+      moves_ = moves;
+      state_.store(EXPANDED, std::memory_order_release);
       return true;
     }
-    void update(size_t winner,
-                const std::array<Board::board_t, 2> &raves) noexcept {
-      ++visits_;
-      log_visits_ = std::log(visits_);
-      wins_ += static_cast<size_t>(winner == bw_);
+    // release drops the virtual loss of the descent, once per descent
+    void update(size_t winner, const std::array<Board::board_t, 2> &raves,
+                TranspositionTable &tt, bool release = true) noexcept {
+      const auto relaxed = std::memory_order_relaxed;
+      const auto win = static_cast<uint32_t>(winner == bw_);
+      stat(VISITS).fetch_add(1, relaxed);
+      stat(WINS).fetch_add(win, relaxed);
+      if (parent_ != nullptr) {
+        if (release) {
+          stat(VIRTUAL_LOSS).fetch_sub(1, relaxed);
+        }
+        // adopt the statistics of all transpositions once they outweigh ours
+        if (tt.enabled()) {
+          auto *entry = tt.find_or_insert(key_);
+          const uint32_t visits = entry->visits.fetch_add(1, relaxed) + 1,
+                         wins = entry->wins.fetch_add(win, relaxed) + win;
+          if (visits > stat(VISITS).load(relaxed)) {
+            stat(VISITS).store(visits, relaxed);
+            stat(WINS).store(wins, relaxed);
+          }
+        }
+      }
       // rave
-      const size_t csize = children_size_,
-                   cwin = static_cast<size_t>(winner == 1 - bw_);
-      const auto &rave = raves[1 - bw_];
-      for (size_t i = 0; i < csize; ++i) {
-        auto &child = children_[i];
-        if (rave.BIT_TEST(child.pos_)) {
-          ++child.rave_visits_;
-          child.rave_wins_ += cwin;
+      if (!has_children()) {
+        return;
+      }
+      const size_t csize = children_size_;
+      stat_t *stats = child_stats_;
+      const auto cwin = static_cast<uint32_t>(winner == 1u - bw_);
+      // only the children whose moves were played
+      for (const size_t pos : raves[1u - bw_] & moves_) {
+        const size_t i = child_index(pos);
+        stats[RAVE_VISITS * csize + i].fetch_add(1, relaxed);
+        stats[RAVE_WINS * csize + i].fetch_add(cwin, relaxed);
+        if (tt.enabled()) {
+          if (Node *child = children_[i].load(std::memory_order_acquire);
+              child != nullptr) {
+            child->update_rave(cwin, tt);
+          }
         }
       }
     }
-    void get_children_visits(std::unordered_map<size_t, size_t> &visits) const
-        noexcept {
+    // make the child at pos the new root, copying its subtree into arena;
+    // the old tree is released with its own arena
+    // adds the number of nodes copied to nodes
+    bool adopt_child(size_t pos, Arena &arena, size_t &nodes) noexcept {
+      if (!has_children() || !moves_.test(pos)) {
+        return false;
+      }
+      const Node *child =
+          children_[child_index(pos)].load(std::memory_order_acquire);
+      if (child == nullptr) {
+        return false;
+      }
+      copy_from(*child, nullptr);
+      clone_children(*child, arena, nodes, 0);
+      return true;
+    }
+    // move this node's subtree into arena, where its descendants with
+    // fewer than min_visits visits, other than its children, are collapsed
+    // into leaves; adds the number of nodes kept to nodes
+    void compact(Arena &arena, uint64_t min_visits, size_t &nodes) noexcept {
+      clone_children(*this, arena, nodes, min_visits);
+    }
+    // bytes of the subtree by the bit width of the visits of the nodes
+    // holding them; the children of the root, which are always kept, are
+    // counted in the last entry
+    using Footprint = std::array<size_t, 34>;
+    void footprint(Footprint &bytes) const noexcept {
+      if (!has_children()) {
+        return;
+      }
+      const size_t size = children_size_;
+      for (size_t i = 0; i < size; ++i) {
+        const Node *child = children_[i].load(std::memory_order_relaxed);
+        if (child == nullptr) {
+          continue;
+        }
+        const uint32_t visits =
+            child_stats_[VISITS * size + i].load(std::memory_order_relaxed);
+        size_t width = 33;
+        if (parent_ != nullptr) {
+          width = visits == 0
+                      ? 0
+                      : 32 - static_cast<size_t>(__builtin_clz(visits));
+        }
+        bytes[width] += Arena::bytes<Node>(1) + child->children_bytes();
+        child->footprint(bytes);
+      }
+    }
+    // bytes of the slots and statistics of the children
+    size_t children_bytes() const noexcept {
+      return has_children()
+                 ? Arena::bytes<std::atomic<Node *>>(children_size_) +
+                       Arena::bytes<stat_t>(FIELDS * children_size_)
+                 : 0;
+    }
+    void get_top_visits(size_t &first, size_t &second) const noexcept {
+      first = second = 0;
+      if (!has_children()) {
+        return;
+      }
+      const stat_t *stats = child_stats_ + VISITS * children_size_;
+      for (size_t i = 0; i < children_size_; ++i) {
+        const size_t visits = stats[i].load(std::memory_order_relaxed);
+        if (visits > first) {
+          second = first;
+          first = visits;
+        } else if (visits > second) {
+          second = visits;
+        }
+      }
+    }
+    // proves this node from its children, which is done after one of them
+    // was proven; returns whether this node is proven
+    bool prove() noexcept {
+      const auto relaxed = std::memory_order_relaxed;
+      if (stat(PROOF).load(relaxed) != UNPROVEN) {
+        return true;
+      }
+      if (!has_children()) {
+        return false;
+      }
+      const size_t size = children_size_;
+      const stat_t *proofs = child_stats_ + PROOF * size;
+      bool lost = true;
+      for (size_t i = 0; i < size; ++i) {
+        const uint32_t proof = proofs[i].load(relaxed);
+        if (proof == WIN) {
+          stat(PROOF).store(LOSS, relaxed);
+          return true;
+        }
+        lost = lost && proof == LOSS;
+      }
+      if (lost) {
+        stat(PROOF).store(WIN, relaxed);
+      }
+      return lost;
+    }
+    uint32_t get_proof() const noexcept {
+      return stat(PROOF).load(std::memory_order_relaxed);
+    }
+    // a child whose move is proven to win, or nullptr
+    const Node *get_winning_child() const noexcept {
+      if (!has_children()) {
+        return nullptr;
+      }
+      const stat_t *proofs = child_stats_ + PROOF * children_size_;
       for (size_t i = 0; i < children_size_; ++i) {
-        const auto &child = children_[i];
-        if (child.visits_ > 0) {
-          visits.emplace(child.pos_, child.visits_);
+        if (proofs[i].load(std::memory_order_relaxed) == WIN) {
+          return children_[i].load(std::memory_order_acquire);
         }
       }
+      return nullptr;
+    }
+    constexpr size_t get_bw() const noexcept { return bw_; }
+    constexpr size_t get_pos() const noexcept { return pos_; }
+    size_t get_visits() const noexcept {
+      return stat(VISITS).load(std::memory_order_relaxed);
+    }
+    size_t get_wins() const noexcept {
+      return stat(WINS).load(std::memory_order_relaxed);
+    }
+    // the children created so far
+    template <class F> void for_each_child(F &&f) const {
+      if (!has_children()) {
+        return;
+      }
+      for (size_t i = 0; i < children_size_; ++i) {
+        if (const Node *child = children_[i].load(std::memory_order_acquire);
+            child != nullptr) {
+          f(*child);
+        }
+      }
+    }
+    void get_children_visits(std::unordered_map<size_t, size_t> &visits) const
+        noexcept {
+      if (!has_children()) {
+        return;
+      }
+      for_each_child([&visits](const Node &child) {
+        const auto child_visits = child.get_visits();
+        if (child_visits > 0) {
+          visits.emplace(child.pos_, child_visits);
+        }
+      });
     }
 
   private:
-    inline constexpr void init(size_t bw, size_t pos, Node *parent) noexcept {
+    // scores are computed over whole vectors of 8 floats
+    const static constexpr size_t simd_size = 88;
+
+    // children are kept in increasing order of their moves
+    size_t child_index(size_t pos) const noexcept {
+      return (moves_ & Board::board_t::mask_below(pos)).count();
+    }
+    stat_t &stat(size_t field) const noexcept {
+      return stats_[field * stride_];
+    }
+    void reset_stats() noexcept { reset_stats(stats_, stride_); }
+    static void reset_stats(stat_t *stats, size_t stride) noexcept {
+      const auto relaxed = std::memory_order_relaxed;
+      stats[WINS * stride].store(0, relaxed);
+      stats[VISITS * stride].store(0, relaxed);
+      stats[RAVE_WINS * stride].store(10, relaxed);
+      stats[RAVE_VISITS * stride].store(20, relaxed);
+      stats[PROOF * stride].store(UNPROVEN, relaxed);
+      stats[VIRTUAL_LOSS * stride].store(0, relaxed);
+    }
+    // empty slots for size children and their statistics
+    bool allocate_children(size_t size, Arena &arena) noexcept {
+      auto *children = arena.allocate<std::atomic<Node *>>(size);
+      auto *stats = arena.allocate<stat_t>(FIELDS * size);
+      if (children == nullptr || stats == nullptr) {
+        return false;
+      }
+      for (size_t i = 0; i < size; ++i) {
+        children[i].store(nullptr, std::memory_order_relaxed);
+      }
+      children_ = children;
+      child_stats_ = stats;
+      return true;
+    }
+    // keeps only the children never selected nor proven among the width
+    // best by RAVE value; the others score between the proven losses and
+    // the open children, by RAVE value, so that they are opened before a
+    // proven loss is taken. Proven losses take no room among the width.
+    static void narrow(size_t width, size_t size,
+                       std::array<float, simd_size> &numerator,
+                       std::array<float, simd_size> &visits,
+                       std::array<float, simd_size> &denominator) noexcept {
+      std::array<float, 81> values;
+      size_t opened = 0, closed = 0;
+      for (size_t i = 0; i < size; ++i) {
+        if (numerator[i] == -0.5f) {
+          continue;
+        }
+        if (visits[i] > 0.f || numerator[i] >= 1e9f) {
+          ++opened;
+        } else {
+          values[closed++] = numerator[i] / denominator[i];
+        }
+      }
+      if (opened + closed <= width) {
+        return;
+      }
+      const size_t room = width > opened ? width - opened : 0;
+      float threshold = std::numeric_limits<float>::infinity();
+      if (room > 0) {
+        std::nth_element(std::begin(values), std::begin(values) + room - 1,
+                         std::begin(values) + closed, std::greater<float>());
+        threshold = values[room - 1];
+      }
+      for (size_t i = 0; i < size; ++i) {
+        if (visits[i] == 0.f && numerator[i] < 1e9f &&
+            numerator[i] != -0.5f &&
+            numerator[i] / denominator[i] < threshold) {
+          numerator[i] = -0.45f + 0.2f * numerator[i] / denominator[i];
+          denominator[i] = 1.f;
+        }
+      }
+    }
+    // indices of the children within 0.0001 of the best UCT-RAVE score
+    static size_t best_scores(float log_visits, size_t size,
+                              std::array<float, simd_size> &numerator,
+                              const std::array<float, simd_size> &visits,
+                              const std::array<float, simd_size> &denominator,
+                              std::array<uint8_t, 81> &ties) noexcept {
+#ifdef __AVX2__
+      const size_t padded = (size + 7) & ~size_t(7);
+      const __m256 log_n = _mm256_set1_ps(log_visits),
+                   c = _mm256_set1_ps(0.25f);
+      __m256 max = _mm256_set1_ps(-1.f);
+      for (size_t i = 0; i < padded; i += 8) {
+        const __m256 v = _mm256_load_ps(&visits[i]);
+        const __m256 score = _mm256_div_ps(
+            _mm256_fmadd_ps(_mm256_sqrt_ps(_mm256_mul_ps(log_n, v)), c,
+                            _mm256_load_ps(&numerator[i])),
+            _mm256_load_ps(&denominator[i]));
+        _mm256_store_ps(&numerator[i], score);
+        max = _mm256_max_ps(max, score);
+      }
+      max = _mm256_max_ps(max, _mm256_permute2f128_ps(max, max, 1));
+      max = _mm256_max_ps(max, _mm256_shuffle_ps(max, max, 0x4e));
+      max = _mm256_max_ps(max, _mm256_shuffle_ps(max, max, 0xb1));
+      const __m256 bound = _mm256_sub_ps(max, _mm256_set1_ps(0.0001f));
+      size_t ties_size = 0;
+      for (size_t i = 0; i < padded; i += 8) {
+        auto mask = static_cast<unsigned>(_mm256_movemask_ps(
+            _mm256_cmp_ps(_mm256_load_ps(&numerator[i]), bound, _CMP_GT_OQ)));
+        for (; mask != 0; mask &= mask - 1) {
+          const auto lane = static_cast<size_t>(__builtin_ctz(mask));
+          ties[ties_size++] = static_cast<uint8_t>(i + lane);
+        }
+      }
+      return ties_size;
+#else
+      float max_score = -1.f;
+      for (size_t i = 0; i < size; ++i) {
+        numerator[i] =
+            (numerator[i] + std::sqrt(log_visits * visits[i]) * 0.25f) /
+            denominator[i];
+        max_score = std::max(max_score, numerator[i]);
+      }
+      size_t ties_size = 0;
+      for (size_t i = 0; i < size; ++i) {
+        if (numerator[i] > max_score - 0.0001f) {
+          ties[ties_size++] = static_cast<uint8_t>(i);
+        }
+      }
+      return ties_size;
+#endif
+    }
+    // a child whose statistics are column index of its parent's
+    inline void init(uint8_t bw, uint8_t pos, Node *parent, uint64_t key,
+                     size_t index) noexcept {
       bw_ = bw;
       pos_ = pos;
       parent_ = parent;
+      key_ = key;
+      stats_ = parent->child_stats_ + index;
+      stride_ = parent->children_size_;
+    }
+    void update_rave(uint32_t win, TranspositionTable &tt) noexcept {
+      const auto relaxed = std::memory_order_relaxed;
+      auto *entry = tt.find(key_);
+      if (entry == nullptr) {
+        return;
+      }
+      // priors are kept by the node only
+      const uint32_t visits = entry->rave_visits.fetch_add(1, relaxed) + 21,
+                     wins = entry->rave_wins.fetch_add(win, relaxed) + win + 10;
+      if (visits > stat(RAVE_VISITS).load(relaxed)) {
+        stat(RAVE_VISITS).store(visits, relaxed);
+        stat(RAVE_WINS).store(wins, relaxed);
+      }
+    }
+    // keeps stats_, the place of this node's own statistics
+    void copy_from(const Node &node, Node *parent) noexcept {
+      const auto relaxed = std::memory_order_relaxed;
+      const uint8_t state = node.state_.load(relaxed);
+      state_.store(state == LEAF ? LEAF : UNEXPANDED, relaxed);
+      children_ = nullptr;
+      child_stats_ = nullptr;
+      children_size_ = 0;
+      bw_ = node.bw_;
+      pos_ = node.pos_;
+      parent_ = parent;
+      key_ = node.key_;
+      for (size_t field = 0; field < VIRTUAL_LOSS; ++field) {
+        stat(field).store(node.stat(field).load(relaxed), relaxed);
+      }
+      stat(VIRTUAL_LOSS).store(0, relaxed);
+    }
+    // subtrees which do not fit into arena are cut back to leaves, and so
+    // are the children of other nodes than the root with fewer than
+    // min_visits visits, their statistics staying with their parent; node
+    // may be this node, copied in place; adds the number of nodes copied
+    // to nodes
+    void clone_children(const Node &node, Arena &arena, size_t &nodes,
+                        uint64_t min_visits) noexcept {
+      const auto relaxed = std::memory_order_relaxed;
+      if (!node.has_children()) {
+        return;
+      }
+      const size_t size = node.children_size_;
+      std::atomic<Node *> *const children = node.children_;
+      const stat_t *const stats = node.child_stats_;
+      if (!allocate_children(size, arena)) {
+        children_ = nullptr;
+        child_stats_ = nullptr;
+        children_size_ = 0;
+        state_.store(UNEXPANDED, relaxed);
+        return;
+      }
+      children_size_ = static_cast<uint8_t>(size);
+      moves_ = node.moves_;
+      for (size_t field = 0; field < VIRTUAL_LOSS; ++field) {
+        for (size_t i = 0; i < size; ++i) {
+          child_stats_[field * size + i].store(
+              stats[field * size + i].load(relaxed), relaxed);
+        }
+      }
+      for (size_t i = 0; i < size; ++i) {
+        child_stats_[VIRTUAL_LOSS * size + i].store(0, relaxed);
+      }
+      for (size_t i = 0; i < size; ++i) {
+        const Node *source = children[i].load(relaxed);
+        if (source == nullptr ||
+            (parent_ != nullptr &&
+             stats[VISITS * size + i].load(relaxed) < min_visits)) {
+          continue;
+        }
+        auto *child = arena.allocate<Node>(1);
+        if (child == nullptr) {
+          break;
+        }
+        child->init(source->bw_, source->pos_, this, source->key_, i);
+        child->copy_from(*source, this);
+        child->clone_children(*source, arena, nodes, min_visits);
+        children_[i].store(child, relaxed);
+        ++nodes;
+      }
+      state_.store(EXPANDED, relaxed);
     }
 
   private:
-    size_t children_size_ = 0;
-    std::unique_ptr<Node[]> children_;
-    size_t bw_, pos_ = 81;
-    bool is_leaf_ = false;
+    enum : uint8_t { UNEXPANDED, EXPANDING, EXPANDED, LEAF };
+    // the children in increasing order of their moves, nullptr until their
+    // first selection
+    std::atomic<Node *> *children_ = nullptr;
+    // the statistics of the children, FIELDS arrays of children_size_
+    stat_t *child_stats_ = nullptr;
     Node *parent_ = nullptr;
-
-  private:
-    size_t wins_ = 0, visits_ = 0, rave_wins_ = 10, rave_visits_ = 20;
-    float log_visits_ = 0.f, uct_score_;
+    uint64_t key_ = 0;
+    // this node's statistics, in the arrays of its parent stride_ apart
+    stat_t *stats_ = nullptr;
+    // moves of the children
+    Board::board_t moves_;
+    std::atomic<uint8_t> state_{UNEXPANDED};
+    uint8_t children_size_ = 0, stride_ = 1, bw_ = 0, pos_ = 81;
   };
 
 public:
   using hclock = std::chrono::high_resolution_clock;
+  using Reporter = std::function<void(const SearchStats &)>;
   const static constexpr auto threshold_time = std::chrono::seconds(1);
+  const static constexpr size_t threshold_simulations = 50000;
+  // simulations between checks whether the best move can still change
+  const static constexpr size_t check_interval = 1024;
 
-  size_t take_action(const Board &b, size_t bw) {
+  explicit MCTSAgent(const MCTSConfig &config = MCTSConfig{})
+      : seed_(config.seed),
+        arena_(std::make_unique<Arena>(config.memory * 512 * 1024)),
+        spare_(std::make_unique<Arena>(config.memory * 512 * 1024)),
+        ponder_(config.ponder), verbose_(config.verbose),
+        batch_(config.batch <= 1
+                   ? 1
+                   : (config.batch + PlayoutBatch::lanes - 1) /
+                         PlayoutBatch::lanes * PlayoutBatch::lanes),
+        solve_(config.solve), widening_(config.widening),
+        shared_weight_(config.shared_weight), tt_(config.tt) {
+    const size_t threads = std::max<size_t>(config.threads, 1);
+    engines_.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+      engines_.emplace_back(seed_());
+    }
+    thread_stats_.resize(threads);
+    if (!config.log.empty()) {
+      log_.open(config.log, std::ios::app);
+    }
+  }
+
+  MCTSAgent(const MCTSAgent &) = delete;
+  MCTSAgent &operator=(const MCTSAgent &) = delete;
+  ~MCTSAgent() { stop(); }
+
+  size_t take_action(const Board &b, size_t bw,
+                     hclock::duration budget = threshold_time,
+                     size_t min_simulations = threshold_simulations) {
+    stop();
     if (!b.has_legal_move(bw)) {
       return 81;
     }
-    size_t total_counts = 0, cbw = 1 - bw, cpos = 81;
+    std::atomic<size_t> total_counts{0};
+    std::atomic<bool> decided{false};
     const auto start_time = hclock::now();
-    Node root;
-    root.init_bw(1 - bw);
-    do {
-      Node *node = &root;
-      Board board(b);
-      // selection
-      std::array<Board::board_t, 2> rave;
-      while (node->has_children()) {
-        node = node->select_child(engine_, cbw, cpos);
-        board.place(cbw, cpos);
-        rave[cbw].set(cpos);
+    if (solve_ > 0 && b.get_two_go().count() <= solve_) {
+      size_t move;
+      const auto result =
+          solver_.solve(b, bw, Solver::clock::now() + budget / 2, move);
+      if (result == Solver::WIN) {
+        // the tree is of an earlier position, whose root children must not
+        // be reported for this one
+        pending_.clear();
+        root_.reset();
+        arena_->reset();
+        stats_ = SearchStats{};
+        stats_.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            hclock::now() - start_time);
+        stats_.solved = true;
+        stats_.pv.push_back(move);
+        report_stats();
+        return move;
       }
-      // expansion
-      if (node->expand(board)) {
-        node = node->select_child(engine_, cbw, cpos);
-        board.place(cbw, cpos);
-        rave[cbw].set(cpos);
+    }
+    prepare_root(b, bw);
+    const size_t reused_visits = root_->get_visits();
+    std::fill(std::begin(thread_stats_), std::end(thread_stats_),
+              ThreadStats{});
+    run(bw, [&](size_t n) {
+      const size_t counts =
+          total_counts.fetch_add(n, std::memory_order_relaxed) + n;
+      if (root_->get_proof() != Node::UNPROVEN) {
+        return true;
       }
-      // simulation
-      const auto init_two_go = board.get_two_go();
-      bool is_two_go;
-      while (board.has_legal_move(1 - cbw)) {
-        cbw = 1 - cbw;
-        cpos = board.heuristic_legal_move(cbw, init_two_go, is_two_go, engine_);
-        board.place(cbw, cpos);
-        if (is_two_go) {
-          rave[cbw].set(cpos);
-        }
+      if (counts < min_simulations) {
+        return false;
       }
-      size_t winner = cbw;
-      // backpropogation
-      while (node != nullptr) {
-        node->update(winner, rave);
-        node = node->get_parent();
+      const auto elapsed = hclock::now() - start_time;
+      if (elapsed >= budget || decided.load(std::memory_order_relaxed)) {
+        return true;
+      }
+      if (counts / check_interval != (counts - n) / check_interval) {
+        // stop once the runner-up cannot catch up in the remaining time
+        size_t first, second;
+        root_->get_top_visits(first, second);
+        const auto remaining = static_cast<double>(counts) *
+                               static_cast<double>((budget - elapsed).count()) /
+                               static_cast<double>(elapsed.count());
+        if (static_cast<double>(first - second) > remaining) {
+          decided.store(true, std::memory_order_relaxed);
+          return true;
+        }
       }
-    } while (++total_counts < 50000 ||
-             (hclock::now() - start_time) < threshold_time);
-    const auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
-                              hclock::now() - start_time)
-                              .count();
-    std::cerr << duration << " ms" << std::endl
-              << total_counts << " simulations" << std::endl;
+      return false;
+    });
+    collect_stats(std::chrono::duration_cast<std::chrono::milliseconds>(
+                      hclock::now() - start_time),
+                  reused_visits);
+    report_stats();
 
+    if (const Node *win = root_->get_winning_child(); win != nullptr) {
+      return win->get_pos();
+    }
     std::unordered_map<size_t, size_t> visits;
-    root.get_children_visits(visits);
+    root_->get_children_visits(visits);
+    if (visits.empty()) {
+      return b.get_legal_moves(bw).find_first();
+    }
     size_t best_move = std::max_element(std::begin(visits), std::end(visits),
                                         [](const auto &p1, const auto &p2) {
                                           return p1.second < p2.second;
@@ -176,7 +760,390 @@ public:
     return best_move;
   }
 
+  // statistics of the last take_action
+  const SearchStats &get_stats() const noexcept { return stats_; }
+
+  // calls reporter with the root children every interval of the searches
+  // to come, from the thread running them; an empty reporter disables it
+  void set_reporter(hclock::duration interval, Reporter reporter) {
+    stop();
+    report_interval_ = interval;
+    reporter_ = std::move(reporter);
+  }
+
+  // visit counts of the root children after the last search
+  void get_children_visits(std::unordered_map<size_t, size_t> &visits) const {
+    if (root_ != nullptr) {
+      root_->get_children_visits(visits);
+    }
+  }
+
+  // search the position with bw to move in the background until stop(),
+  // if pondering is enabled
+  void ponder(const Board &b, size_t bw) {
+    stop();
+    if (ponder_) {
+      analyze(b, bw);
+    }
+  }
+
+  // search the position with bw to move in the background until stop()
+  void analyze(const Board &b, size_t bw) {
+    stop();
+    if (!b.has_legal_move(bw)) {
+      return;
+    }
+    ponder_thread_ = std::thread([this, b, bw] {
+      prepare_root(b, bw);
+      run(bw, [this](size_t) {
+        return stop_.load(std::memory_order_relaxed) ||
+               root_->get_proof() != Node::UNPROVEN;
+      });
+    });
+  }
+
+  void stop() {
+    if (ponder_thread_.joinable()) {
+      stop_.store(true, std::memory_order_relaxed);
+      ponder_thread_.join();
+      stop_.store(false, std::memory_order_relaxed);
+    }
+  }
+
+  // keep the subtree of the move played; the tree itself is moved lazily
+  // so that the caller is not delayed by the copy
+  void play(size_t bw, size_t pos) {
+    stop();
+    if (root_ != nullptr) {
+      pending_.emplace_back(bw, pos);
+    }
+  }
+
+  // drop the tree, as after an undo; the transposition table is kept, its
+  // entries being keyed by position
+  void reset() {
+    stop();
+    pending_.clear();
+    root_.reset();
+    arena_->reset();
+  }
+
+  // drop the tree and the transposition table, whose entries of the old
+  // game would be copied into the new nodes
+  void new_game() {
+    reset();
+    tt_.clear();
+  }
+
 private:
-  splitmix seed_{};
-  xorshift engine_{seed_()};
-};
\ No newline at end of file
+  void prepare_root(const Board &b, size_t bw) {
+    for (const auto &[pbw, ppos] : pending_) {
+      root_board_.place(pbw, ppos);
+      spare_->reset();
+      reused_nodes_ = 0;
+      if (root_->get_bw() == pbw ||
+          !root_->adopt_child(ppos, *spare_, reused_nodes_)) {
+        root_ = std::make_unique<Node>();
+        root_->init_root(pbw, root_board_.get_hash(), root_stats_.data());
+      }
+      std::swap(arena_, spare_);
+      spare_->reset();
+    }
+    pending_.clear();
+    if (root_ == nullptr || root_->get_bw() != 1 - bw || !(root_board_ == b)) {
+      root_ = std::make_unique<Node>();
+      root_->init_root(1 - bw, b.get_hash(), root_stats_.data());
+      root_board_ = b;
+      arena_->reset();
+      reused_nodes_ = 0;
+    }
+  }
+
+  void report_stats() {
+    if (verbose_) {
+      std::cerr << stats_.elapsed.count() << " ms" << std::endl;
+      if (stats_.solved) {
+        std::cerr << "solved" << std::endl;
+      } else {
+        std::cerr << stats_.simulations << " simulations" << std::endl
+                  << stats_.reused << " reused" << std::endl
+                  << stats_.bytes / 1024 << " KiB tree" << std::endl;
+      }
+    }
+    if (log_.is_open()) {
+      stats_.write_json(log_);
+    }
+  }
+
+  void collect_stats(std::chrono::milliseconds elapsed, size_t reused) {
+    stats_ = SearchStats{};
+    stats_.elapsed = elapsed;
+    stats_.reused = reused;
+    for (const auto &stats : thread_stats_) {
+      stats_.add(stats);
+    }
+    // the root itself is not allocated in the arena
+    stats_.bytes = arena_->size() + sizeof(Node) + sizeof(root_stats_);
+    // the threads count the nodes they created
+    stats_.nodes += reused_nodes_ + 1;
+    stats_.collections = collections_;
+    collect_children(stats_);
+  }
+
+  // the visited root children, most visited first, and the principal
+  // variations; safe while the search runs
+  void collect_children(SearchStats &stats) const {
+    root_->for_each_child([&stats](const Node &child) {
+      const size_t visits = child.get_visits();
+      if (visits > 0) {
+        stats.children.push_back({child.get_pos(), visits,
+                                  static_cast<double>(child.get_wins()) /
+                                      static_cast<double>(visits),
+                                  {child.get_pos()}});
+        follow_pv(&child, stats.children.back().pv);
+      }
+    });
+    std::sort(std::begin(stats.children), std::end(stats.children),
+              [](const auto &c1, const auto &c2) {
+                return c1.visits > c2.visits;
+              });
+    // the root is lost for the player who moved into it
+    stats.solved = root_->get_proof() == Node::LOSS;
+    follow_pv(root_.get(), stats.pv);
+  }
+
+  // follows the proven wins, then the most visited children
+  static void follow_pv(const Node *node, std::vector<size_t> &pv) {
+    while (node != nullptr) {
+      const Node *best = node->get_winning_child();
+      node->for_each_child([&best](const Node &child) {
+        if (child.get_visits() > 0 &&
+            (best == nullptr || (best->get_proof() != Node::WIN &&
+                                 child.get_visits() > best->get_visits()))) {
+          best = &child;
+        }
+      });
+      if (best != nullptr) {
+        pv.push_back(best->get_pos());
+      }
+      node = best;
+    }
+  }
+
+  template <class Done> void run(size_t bw, const Done &done) {
+    // the threads pause when the arena is full, until the tree is compacted;
+    // they are joined and started again around each compaction, which costs
+    // about half as much as the smallest compaction
+    std::atomic<bool> finished{false};
+    bool collect = true;
+    const auto pause = [&](size_t n) {
+      if (done(n)) {
+        finished.store(true, std::memory_order_relaxed);
+        return true;
+      }
+      return finished.load(std::memory_order_relaxed) ||
+             (collect && arena_->full());
+    };
+    auto next_report = hclock::now() + report_interval_;
+    collections_ = 0;
+    do {
+      std::vector<std::thread> workers;
+      workers.reserve(engines_.size() - 1);
+      for (size_t i = 1; i < engines_.size(); ++i) {
+        workers.emplace_back(
+            [&, i] { search(bw, engines_[i], thread_stats_[i], pause); });
+      }
+      if (reporter_) {
+        // the calling thread also reports between its simulations
+        search(bw, engines_[0], thread_stats_[0], [&](size_t n) {
+          if (hclock::now() >= next_report) {
+            SearchStats stats;
+            collect_children(stats);
+            reporter_(stats);
+            next_report = hclock::now() + report_interval_;
+          }
+          return pause(n);
+        });
+      } else {
+        search(bw, engines_[0], thread_stats_[0], pause);
+      }
+      for (auto &worker : workers) {
+        worker.join();
+      }
+      // a tree which cannot be compacted stays as it is for the rest of the
+      // search, which simulates from its leaves without expanding them
+      if (!finished.load(std::memory_order_relaxed)) {
+        collect = collect_garbage();
+      }
+    } while (!finished.load(std::memory_order_relaxed));
+  }
+
+  // copies the tree into the spare arena, collapsing the subtrees of its
+  // least visited nodes into leaves until it fills at most half of it, and
+  // makes it the tree; false when the root and its children do not fit
+  bool collect_garbage() {
+    Node::Footprint bytes{};
+    root_->footprint(bytes);
+    const size_t budget = spare_->capacity() / 2;
+    size_t kept = root_->children_bytes() + bytes.back();
+    if (kept > budget) {
+      return false;
+    }
+    // keep the nodes of the most visits, by powers of two
+    size_t width = bytes.size() - 1;
+    while (width > 0 && kept + bytes[width - 1] <= budget) {
+      kept += bytes[--width];
+    }
+    const uint64_t min_visits = width == 0 ? 0 : uint64_t(1) << (width - 1);
+    spare_->reset();
+    reused_nodes_ = 0;
+    root_->compact(*spare_, min_visits, reused_nodes_);
+    std::swap(arena_, spare_);
+    spare_->reset();
+    // the nodes kept are counted as reused
+    for (auto &stats : thread_stats_) {
+      stats.nodes = 0;
+    }
+    ++collections_;
+    return true;
+  }
+
+  template <class Done>
+  void search(size_t bw, xorshift &engine, ThreadStats &stats,
+              const Done &done) {
+    do {
+      ThreadStats::clock::time_point lap;
+      const bool sampled = stats.begin(lap, batch_);
+      size_t cbw = 1 - bw, depth = 0;
+      Node *node = root_.get();
+      Board board(root_board_);
+      std::array<Board::board_t, 2> rave;
+      // one move down the tree, unless the arena has no room for the child
+      const auto descend = [&] {
+        Node *child = node->get_child(node->select_child(engine, widening_),
+                                      *arena_, stats.nodes);
+        if (child == nullptr) {
+          return false;
+        }
+        node = child;
+        cbw = node->get_bw();
+        board.place(cbw, node->get_pos());
+        rave[cbw].set(node->get_pos());
+        ++depth;
+        return true;
+      };
+      // selection, which stops at proven nodes
+      while (node->has_children() && node->get_proof() == Node::UNPROVEN) {
+        if (!descend()) {
+          break;
+        }
+      }
+      stats.lap(sampled, ThreadStats::SELECTION, lap);
+      // expansion
+      if (node->expand(board, *arena_)) {
+        descend();
+      }
+      stats.depth(depth);
+      stats.lap(sampled, ThreadStats::EXPANSION, lap);
+      if (const uint32_t proof = node->get_proof(); proof != Node::UNPROVEN) {
+        // no playout is needed, and the proof may settle the ancestors
+        const size_t winner = proof == Node::WIN ? cbw : 1 - cbw;
+        for (bool proven = true; node != nullptr; node = node->get_parent()) {
+          node->update(winner, rave, tt_);
+          proven = proven && node->prove();
+        }
+        stats.lap(sampled, ThreadStats::BACKPROP, lap);
+        continue;
+      }
+      if (batch_ > 1) {
+        simulate_batch(board, cbw, node, rave, engine, stats, sampled, lap);
+        continue;
+      }
+      // simulation
+      const size_t winner = playout(board, cbw, rave, engine);
+      stats.lap(sampled, ThreadStats::PLAYOUT, lap);
+      // backpropogation
+      while (node != nullptr) {
+        node->update(winner, rave, tt_);
+        node = node->get_parent();
+      }
+      stats.lap(sampled, ThreadStats::BACKPROP, lap);
+    } while (!done(batch_));
+  }
+
+  // plays out board after bw moved and returns the winner; the moves on
+  // points open to both sides at the start are added to rave
+  size_t playout(Board &board, size_t bw, std::array<Board::board_t, 2> &rave,
+                 xorshift &engine) const {
+    const auto init_two_go = board.get_two_go();
+    if (shared_weight_ > 0) {
+      while (board.has_legal_move(1 - bw)) {
+        bw = 1 - bw;
+        const size_t pos =
+            board.weighted_legal_move(bw, shared_weight_, engine);
+        board.place(bw, pos);
+        if (init_two_go.test(pos)) {
+          rave[bw].set(pos);
+        }
+      }
+      return bw;
+    }
+    bool is_two_go;
+    while (board.has_legal_move(1 - bw)) {
+      bw = 1 - bw;
+      const size_t pos =
+          board.heuristic_legal_move(bw, init_two_go, is_two_go, engine);
+      board.place(bw, pos);
+      if (is_two_go) {
+        rave[bw].set(pos);
+      }
+    }
+    return bw;
+  }
+
+  // batch_ playouts of the leaf in lockstep, each backpropagated on its own
+  void simulate_batch(const Board &board, size_t bw, Node *leaf,
+                      const std::array<Board::board_t, 2> &rave,
+                      xorshift &engine, ThreadStats &stats, bool sampled,
+                      ThreadStats::clock::time_point &lap) {
+    constexpr size_t lanes = PlayoutBatch::lanes;
+    std::array<size_t, lanes> winners;
+    std::array<std::array<Board::board_t, 2>, lanes> raves;
+    for (size_t i = 0; i < batch_; i += lanes) {
+      raves.fill(rave);
+      PlayoutBatch::playout(board, bw, shared_weight_, engine, winners,
+                            raves);
+      stats.lap(sampled, ThreadStats::PLAYOUT, lap);
+      for (size_t j = 0; j < lanes; ++j) {
+        for (Node *node = leaf; node != nullptr; node = node->get_parent()) {
+          node->update(winners[j], raves[j], tt_, i + j == 0);
+        }
+      }
+      stats.lap(sampled, ThreadStats::BACKPROP, lap);
+    }
+  }
+
+private:
+  splitmix seed_;
+  std::vector<xorshift> engines_;
+  std::unique_ptr<Arena> arena_, spare_;
+  std::unique_ptr<Node> root_;
+  std::array<Node::stat_t, Node::FIELDS> root_stats_;
+  Board root_board_;
+  std::vector<std::pair<size_t, size_t>> pending_;
+  bool ponder_, verbose_;
+  size_t batch_, solve_, widening_, shared_weight_;
+  Solver solver_;
+  std::thread ponder_thread_;
+  std::atomic<bool> stop_{false};
+  TranspositionTable tt_;
+  std::vector<ThreadStats> thread_stats_;
+  SearchStats stats_;
+  Reporter reporter_;
+  // nodes copied from the previous tree, or kept by the last compaction
+  size_t reused_nodes_ = 0;
+  // compactions of the tree during the last search
+  size_t collections_ = 0;
+  hclock::duration report_interval_{0};
+  std::ofstream log_;
+};
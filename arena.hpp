@@ -0,0 +1,54 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+// Bump allocator owning the storage of a whole search tree. Objects are
+// never freed one by one: reset() releases everything at once.
+class Arena {
+public:
+  static constexpr size_t alignment = alignof(std::max_align_t);
+
+  Arena() = default;
+  explicit Arena(size_t capacity)
+      : capacity_(capacity), buffer_(new std::byte[capacity]) {}
+
+  // storage taken by an allocation of n objects of type T
+  template <class T> static constexpr size_t bytes(size_t n) noexcept {
+    return (sizeof(T) * n + alignment - 1) & ~(alignment - 1);
+  }
+
+  // returns nullptr once the capacity is exhausted
+  template <class T> T *allocate(size_t n) noexcept {
+    static_assert(std::is_trivially_destructible_v<T>);
+    static_assert(alignof(T) <= alignment);
+    const size_t offset =
+        size_.fetch_add(bytes<T>(n), std::memory_order_relaxed);
+    if (offset + bytes<T>(n) > capacity_) {
+      return nullptr;
+    }
+    auto *ret = reinterpret_cast<T *>(buffer_.get() + offset);
+    for (size_t i = 0; i < n; ++i) {
+      new (ret + i) T();
+    }
+    return ret;
+  }
+
+  void reset() noexcept { size_.store(0, std::memory_order_relaxed); }
+
+  size_t size() const noexcept {
+    return std::min(size_.load(std::memory_order_relaxed), capacity_);
+  }
+  constexpr size_t capacity() const noexcept { return capacity_; }
+  bool full() const noexcept {
+    return size_.load(std::memory_order_relaxed) > capacity_;
+  }
+
+private:
+  size_t capacity_ = 0;
+  std::unique_ptr<std::byte[]> buffer_;
+  std::atomic<size_t> size_{0};
+};
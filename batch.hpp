@@ -0,0 +1,368 @@
+#pragma once
+#include "bitboard.hpp"
+#include "board.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Four 64-bit words processed together: one AVX2 register, or a plain
+// array the compiler may vectorise on its own.
+class Lanes {
+public:
+  static constexpr size_t size = 4;
+
+  Lanes() noexcept = default;
+  static Lanes broadcast(uint64_t x) noexcept {
+#ifdef __AVX2__
+    return Lanes(_mm256_set1_epi64x(static_cast<long long>(x)));
+#else
+    Lanes ret;
+    ret.v_.fill(x);
+    return ret;
+#endif
+  }
+  static Lanes load(const uint64_t *p) noexcept {
+#ifdef __AVX2__
+    return Lanes(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)));
+#else
+    Lanes ret;
+    std::copy(p, p + size, std::begin(ret.v_));
+    return ret;
+#endif
+  }
+  void store(uint64_t *p) const noexcept {
+#ifdef __AVX2__
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v_);
+#else
+    std::copy(std::begin(v_), std::end(v_), p);
+#endif
+  }
+  // all ones in the lanes whose bit is set in mask
+  static Lanes from_mask(unsigned mask) noexcept {
+#ifdef __AVX2__
+    const __m256i bits = _mm256_set_epi64x(8, 4, 2, 1);
+    const __m256i m = _mm256_and_si256(
+        _mm256_set1_epi64x(static_cast<long long>(mask)), bits);
+    return Lanes(_mm256_cmpeq_epi64(m, bits));
+#else
+    Lanes ret;
+    for (size_t i = 0; i < size; ++i) {
+      ret.v_[i] = (mask >> i) & 1 ? ~uint64_t(0) : 0;
+    }
+    return ret;
+#endif
+  }
+
+  // bit i set when lane i is zero
+  unsigned zero_mask() const noexcept {
+#ifdef __AVX2__
+    const __m256i eq = _mm256_cmpeq_epi64(v_, _mm256_setzero_si256());
+    return static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(eq)));
+#else
+    unsigned ret = 0;
+    for (size_t i = 0; i < size; ++i) {
+      ret |= static_cast<unsigned>(v_[i] == 0) << i;
+    }
+    return ret;
+#endif
+  }
+  bool none() const noexcept {
+#ifdef __AVX2__
+    return _mm256_testz_si256(v_, v_) != 0;
+#else
+    return zero_mask() == (1u << size) - 1;
+#endif
+  }
+
+  template <int n> Lanes shl() const noexcept {
+#ifdef __AVX2__
+    return Lanes(_mm256_slli_epi64(v_, n));
+#else
+    return map([](uint64_t x) { return x << n; });
+#endif
+  }
+  template <int n> Lanes shr() const noexcept {
+#ifdef __AVX2__
+    return Lanes(_mm256_srli_epi64(v_, n));
+#else
+    return map([](uint64_t x) { return x >> n; });
+#endif
+  }
+  // every lane with its lowest set bit cleared
+  Lanes clear_lowest() const noexcept {
+#ifdef __AVX2__
+    return Lanes(
+        _mm256_and_si256(v_, _mm256_sub_epi64(v_, _mm256_set1_epi64x(1))));
+#else
+    return map([](uint64_t x) { return x & (x - 1); });
+#endif
+  }
+
+  Lanes operator~() const noexcept {
+#ifdef __AVX2__
+    return Lanes(_mm256_xor_si256(v_, _mm256_set1_epi64x(-1)));
+#else
+    return map([](uint64_t x) { return ~x; });
+#endif
+  }
+  friend Lanes operator&(const Lanes &lhs, const Lanes &rhs) noexcept {
+#ifdef __AVX2__
+    return Lanes(_mm256_and_si256(lhs.v_, rhs.v_));
+#else
+    return lhs.zip(rhs, [](uint64_t x, uint64_t y) { return x & y; });
+#endif
+  }
+  friend Lanes operator|(const Lanes &lhs, const Lanes &rhs) noexcept {
+#ifdef __AVX2__
+    return Lanes(_mm256_or_si256(lhs.v_, rhs.v_));
+#else
+    return lhs.zip(rhs, [](uint64_t x, uint64_t y) { return x | y; });
+#endif
+  }
+  friend Lanes operator^(const Lanes &lhs, const Lanes &rhs) noexcept {
+#ifdef __AVX2__
+    return Lanes(_mm256_xor_si256(lhs.v_, rhs.v_));
+#else
+    return lhs.zip(rhs, [](uint64_t x, uint64_t y) { return x ^ y; });
+#endif
+  }
+  // lhs & ~rhs
+  friend Lanes andnot(const Lanes &lhs, const Lanes &rhs) noexcept {
+#ifdef __AVX2__
+    return Lanes(_mm256_andnot_si256(rhs.v_, lhs.v_));
+#else
+    return lhs.zip(rhs, [](uint64_t x, uint64_t y) { return x & ~y; });
+#endif
+  }
+
+private:
+#ifdef __AVX2__
+  explicit Lanes(__m256i v) noexcept : v_(v) {}
+  __m256i v_;
+#else
+  template <class F> Lanes map(F &&f) const noexcept {
+    Lanes ret;
+    for (size_t i = 0; i < size; ++i) {
+      ret.v_[i] = f(v_[i]);
+    }
+    return ret;
+  }
+  template <class F> Lanes zip(const Lanes &rhs, F &&f) const noexcept {
+    Lanes ret;
+    for (size_t i = 0; i < size; ++i) {
+      ret.v_[i] = f(v_[i], rhs.v_[i]);
+    }
+    return ret;
+  }
+  std::array<uint64_t, size> v_;
+#endif
+};
+
+// One Bitboard81 per lane, with the lo and hi words of all lanes apart.
+class Bitboard81x4 {
+public:
+  Bitboard81x4() noexcept
+      : lo_(Lanes::broadcast(0)), hi_(Lanes::broadcast(0)) {}
+  Bitboard81x4(const Lanes &lo, const Lanes &hi) noexcept : lo_(lo), hi_(hi) {}
+  static Bitboard81x4 broadcast(const Bitboard81 &b) noexcept {
+    return {Lanes::broadcast(b.lo()), Lanes::broadcast(b.hi())};
+  }
+  static Bitboard81x4 load(const uint64_t *lo, const uint64_t *hi) noexcept {
+    return {Lanes::load(lo), Lanes::load(hi)};
+  }
+  void store(uint64_t *lo, uint64_t *hi) const noexcept {
+    lo_.store(lo);
+    hi_.store(hi);
+  }
+
+  // bit i set when lane i is empty, or holds exactly one point
+  unsigned none_mask() const noexcept {
+    return lo_.zero_mask() & hi_.zero_mask();
+  }
+  unsigned single_mask() const noexcept {
+    const unsigned lo_zero = lo_.zero_mask(), hi_zero = hi_.zero_mask();
+    return lo_.clear_lowest().zero_mask() & hi_.clear_lowest().zero_mask() &
+           (lo_zero ^ hi_zero);
+  }
+  bool none() const noexcept { return (lo_ | hi_).none(); }
+  // the lanes whose bit is set in mask, others cleared
+  Bitboard81x4 keep(unsigned mask) const noexcept {
+    const auto m = Lanes::from_mask(mask);
+    return {lo_ & m, hi_ & m};
+  }
+
+  // the shifts used by neighbours(), per lane
+  Bitboard81x4 up() const noexcept {
+    return {lo_.shr<9>() | hi_.shl<55>(), hi_.shr<9>()};
+  }
+  Bitboard81x4 down() const noexcept {
+    return {lo_.shl<9>(), (hi_.shl<9>() | lo_.shr<55>()) & hi_mask()};
+  }
+  Bitboard81x4 left() const noexcept {
+    const auto b = *this & broadcast(MASK_LEFT);
+    return {b.lo_.shr<1>() | b.hi_.shl<63>(), b.hi_.shr<1>()};
+  }
+  Bitboard81x4 right() const noexcept {
+    const auto b = *this & broadcast(MASK_RIGHT);
+    return {b.lo_.shl<1>(), b.hi_.shl<1>() | b.lo_.shr<63>()};
+  }
+  Bitboard81x4 neighbours() const noexcept {
+    return up() | down() | left() | right();
+  }
+
+  // the groups of stones containing seed
+  Bitboard81x4 flood(const Bitboard81x4 &stones) const noexcept {
+    auto group = *this & stones;
+    while (true) {
+      const auto next = group | (group.neighbours() & stones);
+      if ((next ^ group).none()) {
+        return group;
+      }
+      group = next;
+    }
+  }
+
+  Bitboard81x4 operator~() const noexcept {
+    return {~lo_, ~hi_ & Lanes::broadcast(Bitboard81::HI_MASK)};
+  }
+  friend Bitboard81x4 operator&(const Bitboard81x4 &lhs,
+                                const Bitboard81x4 &rhs) noexcept {
+    return {lhs.lo_ & rhs.lo_, lhs.hi_ & rhs.hi_};
+  }
+  friend Bitboard81x4 operator|(const Bitboard81x4 &lhs,
+                                const Bitboard81x4 &rhs) noexcept {
+    return {lhs.lo_ | rhs.lo_, lhs.hi_ | rhs.hi_};
+  }
+  friend Bitboard81x4 operator^(const Bitboard81x4 &lhs,
+                                const Bitboard81x4 &rhs) noexcept {
+    return {lhs.lo_ ^ rhs.lo_, lhs.hi_ ^ rhs.hi_};
+  }
+  // lhs & ~rhs
+  friend Bitboard81x4 andnot(const Bitboard81x4 &lhs,
+                             const Bitboard81x4 &rhs) noexcept {
+    return {andnot(lhs.lo_, rhs.lo_), andnot(lhs.hi_, rhs.hi_)};
+  }
+
+private:
+  static Lanes hi_mask() noexcept {
+    return Lanes::broadcast(Bitboard81::HI_MASK);
+  }
+
+  Lanes lo_, hi_;
+};
+
+// Random playouts of one position in lockstep, one per lane. Legality is
+// kept like in Board, but the groups next to each move are flooded instead
+// of looked up, so that all lanes take the same path.
+class PlayoutBatch {
+public:
+  static constexpr size_t lanes = Lanes::size;
+
+  // bw made the last move of b; winners and raves receive the results, the
+  // raves adding the moves played at the initial two-go points. Moves are
+  // drawn like Board::weighted_legal_move with weight, or with 0 among the
+  // initial two-go points first, then among all legal points.
+  template <class PRNG>
+  static void playout(const Board &b, size_t bw, size_t weight, PRNG &rng,
+                      std::array<size_t, lanes> &winners,
+                      std::array<std::array<Bitboard81, 2>, lanes> &raves) {
+    PlayoutBatch batch(b);
+    const auto init_two_go = b.get_two_go();
+    alignas(32) uint64_t lo[lanes], hi[lanes], move_lo[lanes], move_hi[lanes];
+    alignas(32) uint64_t other_lo[lanes], other_hi[lanes];
+    unsigned active = (1u << lanes) - 1;
+    while (true) {
+      const size_t cbw = 1 - bw;
+      (~batch.forbid_[cbw]).store(lo, hi);
+      if (weight > 0) {
+        (~batch.forbid_[bw]).store(other_lo, other_hi);
+      }
+      for (size_t i = 0; i < lanes; ++i) {
+        move_lo[i] = move_hi[i] = 0;
+        if ((active >> i & 1) == 0) {
+          continue;
+        }
+        const Bitboard81 legal(lo[i], hi[i]);
+        if (legal.none()) {
+          winners[i] = bw;
+          active &= ~(1u << i);
+          continue;
+        }
+        size_t p;
+        if (weight > 0) {
+          const Bitboard81 other(other_lo[i], other_hi[i]);
+          p = Board::weighted_move_from_board(legal, legal & other, weight,
+                                              rng);
+          if (init_two_go.test(p)) {
+            raves[i][cbw].set(p);
+          }
+        } else if (const auto legal_two_go = legal & init_two_go;
+                   legal_two_go.any()) {
+          p = Board::random_move_from_board(legal_two_go, rng);
+          raves[i][cbw].set(p);
+        } else {
+          p = Board::random_move_from_board(legal, rng);
+        }
+        const auto move = Bitboard81::single(p);
+        move_lo[i] = move.lo();
+        move_hi[i] = move.hi();
+      }
+      if (active == 0) {
+        return;
+      }
+      batch.place(cbw, Bitboard81x4::load(move_lo, move_hi));
+      bw = cbw;
+    }
+  }
+
+private:
+  explicit PlayoutBatch(const Board &b) noexcept
+      : stones_{Bitboard81x4::broadcast(b.get_stones(0)),
+                Bitboard81x4::broadcast(b.get_stones(1))},
+        forbid_{Bitboard81x4::broadcast(~b.get_legal_moves(0)),
+                Bitboard81x4::broadcast(~b.get_legal_moves(1))} {}
+
+  // at most one point per lane; lanes without one are left as they are
+  void place(size_t bw, const Bitboard81x4 &p) noexcept {
+    const size_t op = 1 - bw;
+    stones_[bw] = stones_[bw] | p;
+    forbid_[bw] = forbid_[bw] | p;
+    forbid_[op] = forbid_[op] | p;
+    check_valid(bw, p);
+    const Bitboard81x4 neighbours[] = {p.up(), p.down(), p.left(), p.right()};
+    for (const auto &x : neighbours) {
+      check_valid(op, x & stones_[op]);
+      check_no_liberty(op, andnot(x, stones_[0] | stones_[1]));
+    }
+  }
+
+  // groups of bw at p left with a single liberty forbid it to the other side
+  void check_valid(size_t bw, const Bitboard81x4 &p) noexcept {
+    if (p.none()) {
+      return;
+    }
+    const auto empty = ~(stones_[0] | stones_[1]);
+    const auto liberty = p.flood(stones_[bw]).neighbours() & empty;
+    const auto x = liberty.keep(liberty.single_mask());
+    forbid_[1 - bw] = forbid_[1 - bw] | x;
+    check_no_liberty(bw, x);
+  }
+
+  // whether bw at the empty point x would have no liberty
+  void check_no_liberty(size_t bw, Bitboard81x4 x) noexcept {
+    const auto empty = ~(stones_[0] | stones_[1]);
+    x = x.keep((x.neighbours() & empty).none_mask());
+    if (x.none()) {
+      return;
+    }
+    const auto group = (x.neighbours() & stones_[bw]).flood(stones_[bw]);
+    const auto liberty = andnot(group.neighbours() & empty, x);
+    forbid_[bw] = forbid_[bw] | x.keep(liberty.none_mask());
+  }
+
+  Bitboard81x4 stones_[2], forbid_[2];
+};
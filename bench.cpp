@@ -0,0 +1,204 @@
+#include "agent.hpp"
+#include "batch.hpp"
+#include "board.hpp"
+#include "random.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+// Reproducible engine benchmarks printing one JSON object per line, so that
+// runs of two builds can be compared by a script.
+namespace {
+
+using hclock = std::chrono::high_resolution_clock;
+
+// the linear scan random_move_from_board used before Bitboard81::select
+template <class PRNG>
+size_t random_move_scan(const Board::board_t &valid, PRNG &rng) noexcept {
+  const size_t index = rng() % valid.count();
+  size_t action = valid.find_first();
+  for (size_t i = 0; i < index; ++i) {
+    action = valid.find_next(action);
+  }
+  return action;
+}
+
+std::vector<Board::board_t> random_sets(size_t n, size_t density,
+                                        uint64_t seed) {
+  xorshift rng(seed);
+  std::vector<Board::board_t> ret(n);
+  for (auto &set : ret) {
+    for (size_t p = 0; p < 81; ++p) {
+      if (rng() % 81 < density) {
+        set.set(p);
+      }
+    }
+    if (set.none()) {
+      set.set(rng() % 81);
+    }
+  }
+  return ret;
+}
+
+// positions after `plies` random moves, with the side to move
+std::vector<std::pair<Board, size_t>> random_positions(size_t n, size_t plies,
+                                                       uint64_t seed) {
+  xorshift rng(seed);
+  std::vector<std::pair<Board, size_t>> ret;
+  ret.reserve(n);
+  while (ret.size() < n) {
+    Board b;
+    size_t bw = 0, ply = 0;
+    for (; ply < plies && b.has_legal_move(bw); ++ply, bw = 1 - bw) {
+      b.place(bw, b.random_legal_move(bw, rng));
+    }
+    if (ply == plies && b.has_legal_move(bw)) {
+      ret.emplace_back(b, bw);
+    }
+  }
+  return ret;
+}
+
+template <class F>
+void report(std::string_view name, std::string_view set, size_t iterations,
+            F &&f) {
+  const auto start_time = hclock::now();
+  size_t checksum = 0;
+  for (size_t i = 0; i < iterations; ++i) {
+    checksum += f(i);
+  }
+  const auto ns = std::chrono::duration<double, std::nano>(hclock::now() -
+                                                           start_time)
+                      .count();
+  std::cout << "{\"bench\":\"" << name << "\",\"set\":\"" << set
+            << "\",\"iterations\":" << iterations
+            << ",\"ns_per_op\":" << ns / static_cast<double>(iterations)
+            << ",\"ops_per_sec\":" << static_cast<double>(iterations) * 1e9 / ns
+            << ",\"checksum\":" << checksum << "}" << std::endl;
+}
+
+void bench_random_move(size_t iterations, uint64_t seed) {
+  const std::pair<std::string_view, size_t> densities[] = {
+      {"sparse", 4}, {"half", 40}, {"dense", 76}};
+  for (const auto &[set_name, density] : densities) {
+    const auto sets = random_sets(1024, density, seed);
+    xorshift rng(seed + 1);
+    report("random_move_scan", set_name, iterations, [&](size_t i) {
+      return random_move_scan(sets[i % sets.size()], rng);
+    });
+    rng.seed(seed + 1);
+    report("random_move_from_board", set_name, iterations, [&](size_t i) {
+      return Board::random_move_from_board(sets[i % sets.size()], rng);
+    });
+  }
+}
+
+// every legal move of each position, each placed on a fresh copy
+void bench_place(size_t iterations, uint64_t seed) {
+  const std::pair<std::string_view, size_t> phases[] = {
+      {"opening", 4}, {"middle", 24}, {"late", 40}};
+  for (const auto &[set_name, plies] : phases) {
+    const auto positions = random_positions(256, plies, seed);
+    std::vector<std::pair<size_t, size_t>> moves;
+    for (size_t i = 0; i < positions.size(); ++i) {
+      const auto &[b, bw] = positions[i];
+      for (const size_t p : b.get_legal_moves(bw)) {
+        moves.emplace_back(i, p);
+      }
+    }
+    report("place", set_name, iterations, [&](size_t i) {
+      const auto &[index, p] = moves[i % moves.size()];
+      const auto &[b, bw] = positions[index];
+      Board board(b);
+      board.place(bw, p);
+      return board.get_legal_moves(1 - bw).count();
+    });
+    report("get_legal_moves", set_name, iterations, [&](size_t i) {
+      const auto &[b, bw] = positions[i % positions.size()];
+      return b.get_legal_moves(bw).count() + b.get_two_go().count();
+    });
+  }
+}
+
+// the simulation phase of MCTSAgent from fixed positions
+void bench_playout(size_t iterations, uint64_t seed) {
+  const std::pair<std::string_view, size_t> phases[] = {
+      {"opening", 0}, {"middle", 24}};
+  for (const auto &[set_name, plies] : phases) {
+    const auto positions = random_positions(256, plies, seed);
+    xorshift rng(seed + 1);
+    report("playout", set_name, iterations, [&](size_t i) {
+      const auto &[b, bw] = positions[i % positions.size()];
+      Board board(b);
+      const auto init_two_go = board.get_two_go();
+      bool is_two_go;
+      size_t cbw = 1 - bw;
+      while (board.has_legal_move(1 - cbw)) {
+        cbw = 1 - cbw;
+        board.place(cbw, board.heuristic_legal_move(cbw, init_two_go,
+                                                    is_two_go, rng));
+      }
+      return cbw;
+    });
+    // the weighted policy, as played by default
+    rng.seed(seed + 1);
+    report("weighted_playout", set_name, iterations, [&](size_t i) {
+      const auto &[b, bw] = positions[i % positions.size()];
+      Board board(b);
+      size_t cbw = 1 - bw;
+      while (board.has_legal_move(1 - cbw)) {
+        cbw = 1 - cbw;
+        board.place(cbw, board.weighted_legal_move(
+                             cbw, MCTSConfig{}.shared_weight, rng));
+      }
+      return cbw;
+    });
+    // the same playouts, PlayoutBatch::lanes at a time
+    constexpr size_t lanes = PlayoutBatch::lanes;
+    rng.seed(seed + 1);
+    std::array<size_t, lanes> winners;
+    std::array<std::array<Board::board_t, 2>, lanes> raves;
+    report("batch_playout", set_name, iterations, [&](size_t i) {
+      if (i % lanes != 0) {
+        return winners[i % lanes];
+      }
+      const auto &[b, bw] = positions[i / lanes % positions.size()];
+      PlayoutBatch::playout(b, 1 - bw, 0, rng, winners, raves);
+      return winners[0];
+    });
+  }
+}
+
+// whole searches of a given number of simulations from the empty board
+void bench_search(uint64_t seed) {
+  const std::tuple<std::string_view, size_t, size_t> sizes[] = {
+      {"1k", 1000, 1},
+      {"10k", 10000, 1},
+      {"100k", 100000, 1},
+      {"100k_batch4", 100000, 4}};
+  for (const auto &[set_name, simulations, batch] : sizes) {
+    MCTSConfig config;
+    config.seed = seed;
+    config.batch = batch;
+    MCTSAgent agent(config);
+    const Board b;
+    report("search_simulation", set_name, simulations, [&](size_t i) {
+      return i == 0 ? agent.take_action(b, 0, hclock::duration::zero(),
+                                        simulations)
+                    : 0;
+    });
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const uint64_t seed = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1;
+  bench_random_move(10000000, seed);
+  bench_place(1000000, seed);
+  bench_playout(100000, seed);
+  bench_search(seed);
+}
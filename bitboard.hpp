@@ -0,0 +1,218 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+// 9x9 board bitset: point p is bit p of lo_ (p < 64) or bit p - 64 of hi_.
+class Bitboard81 {
+public:
+  static constexpr uint64_t HI_MASK = (uint64_t(1) << 17) - 1;
+
+  constexpr Bitboard81() noexcept = default;
+  constexpr Bitboard81(uint64_t lo, uint64_t hi) noexcept
+      : lo_(lo), hi_(hi & HI_MASK) {}
+
+  static constexpr Bitboard81 full() noexcept {
+    return {~uint64_t(0), HI_MASK};
+  }
+  static constexpr Bitboard81 single(size_t p) noexcept {
+    return p < 64 ? Bitboard81{uint64_t(1) << p, 0}
+                  : Bitboard81{0, uint64_t(1) << (p - 64)};
+  }
+
+  constexpr uint64_t lo() const noexcept { return lo_; }
+  constexpr uint64_t hi() const noexcept { return hi_; }
+
+  constexpr bool test(size_t p) const noexcept {
+    return p < 64 ? (lo_ >> p) & 1 : (hi_ >> (p - 64)) & 1;
+  }
+  constexpr Bitboard81 &set(size_t p) noexcept { return *this |= single(p); }
+  constexpr Bitboard81 &reset(size_t p) noexcept {
+    return *this &= ~single(p);
+  }
+
+  constexpr size_t count() const noexcept {
+    return static_cast<size_t>(__builtin_popcountll(lo_) +
+                               __builtin_popcountll(hi_));
+  }
+  constexpr bool any() const noexcept { return (lo_ | hi_) != 0; }
+  constexpr bool none() const noexcept { return (lo_ | hi_) == 0; }
+  constexpr bool all() const noexcept {
+    return lo_ == ~uint64_t(0) && hi_ == HI_MASK;
+  }
+
+  // lowest set point, or 81 when empty
+  constexpr size_t find_first() const noexcept {
+    return lo_ != 0   ? static_cast<size_t>(__builtin_ctzll(lo_))
+           : hi_ != 0 ? static_cast<size_t>(__builtin_ctzll(hi_)) + 64
+                      : 81;
+  }
+  // lowest set point above p, or 81 when there is none
+  constexpr size_t find_next(size_t p) const noexcept {
+    return p + 1 >= 81 ? 81 : (*this & ~mask_below(p + 1)).find_first();
+  }
+
+  // k-th lowest set point, k < count()
+  size_t select(size_t k) const noexcept {
+    const auto lo_count = static_cast<size_t>(__builtin_popcountll(lo_));
+    return k < lo_count ? select64(lo_, k) : select64(hi_, k - lo_count) + 64;
+  }
+
+  // points 0 .. p - 1
+  static constexpr Bitboard81 mask_below(size_t p) noexcept {
+    return p < 64 ? Bitboard81{(uint64_t(1) << p) - 1, 0}
+                  : Bitboard81{~uint64_t(0), (uint64_t(1) << (p - 64)) - 1};
+  }
+
+  // shifts by 0 <= n < 81 points; constant shifts fold to a single case
+  constexpr Bitboard81 operator<<(size_t n) const noexcept {
+    return n == 0   ? *this
+           : n < 64 ? Bitboard81{lo_ << n, (hi_ << n) | (lo_ >> (64 - n))}
+                    : Bitboard81{0, lo_ << (n - 64)};
+  }
+  constexpr Bitboard81 operator>>(size_t n) const noexcept {
+    return n == 0   ? *this
+           : n < 64 ? Bitboard81{(lo_ >> n) | (hi_ << (64 - n)), hi_ >> n}
+                    : Bitboard81{hi_ >> (n - 64), 0};
+  }
+
+  // 4-neighbourhood of all points, without the points themselves
+  constexpr Bitboard81 neighbours() const noexcept;
+
+  constexpr Bitboard81 operator~() const noexcept { return {~lo_, ~hi_}; }
+  constexpr Bitboard81 &operator&=(const Bitboard81 &rhs) noexcept {
+    lo_ &= rhs.lo_;
+    hi_ &= rhs.hi_;
+    return *this;
+  }
+  constexpr Bitboard81 &operator|=(const Bitboard81 &rhs) noexcept {
+    lo_ |= rhs.lo_;
+    hi_ |= rhs.hi_;
+    return *this;
+  }
+  constexpr Bitboard81 &operator^=(const Bitboard81 &rhs) noexcept {
+    lo_ ^= rhs.lo_;
+    hi_ ^= rhs.hi_;
+    return *this;
+  }
+  friend constexpr Bitboard81 operator&(Bitboard81 lhs,
+                                        const Bitboard81 &rhs) noexcept {
+    return lhs &= rhs;
+  }
+  friend constexpr Bitboard81 operator|(Bitboard81 lhs,
+                                        const Bitboard81 &rhs) noexcept {
+    return lhs |= rhs;
+  }
+  friend constexpr Bitboard81 operator^(Bitboard81 lhs,
+                                        const Bitboard81 &rhs) noexcept {
+    return lhs ^= rhs;
+  }
+  friend constexpr bool operator==(const Bitboard81 &lhs,
+                                   const Bitboard81 &rhs) noexcept {
+    return lhs.lo_ == rhs.lo_ && lhs.hi_ == rhs.hi_;
+  }
+  friend constexpr bool operator!=(const Bitboard81 &lhs,
+                                   const Bitboard81 &rhs) noexcept {
+    return !(lhs == rhs);
+  }
+
+  // iterates the set points in increasing order
+  class iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = size_t;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const size_t *;
+    using reference = size_t;
+
+    constexpr iterator() noexcept = default;
+    constexpr explicit iterator(const Bitboard81 &b) noexcept
+        : lo_(b.lo_), hi_(b.hi_) {}
+    constexpr size_t operator*() const noexcept {
+      return lo_ != 0 ? static_cast<size_t>(__builtin_ctzll(lo_))
+                      : static_cast<size_t>(__builtin_ctzll(hi_)) + 64;
+    }
+    constexpr iterator &operator++() noexcept {
+      if (lo_ != 0) {
+        lo_ &= lo_ - 1;
+      } else {
+        hi_ &= hi_ - 1;
+      }
+      return *this;
+    }
+    constexpr iterator operator++(int) noexcept {
+      iterator ret(*this);
+      ++*this;
+      return ret;
+    }
+    friend constexpr bool operator==(const iterator &lhs,
+                                     const iterator &rhs) noexcept {
+      return lhs.lo_ == rhs.lo_ && lhs.hi_ == rhs.hi_;
+    }
+    friend constexpr bool operator!=(const iterator &lhs,
+                                     const iterator &rhs) noexcept {
+      return !(lhs == rhs);
+    }
+
+  private:
+    uint64_t lo_ = 0, hi_ = 0;
+  };
+  constexpr iterator begin() const noexcept { return iterator(*this); }
+  constexpr iterator end() const noexcept { return iterator(); }
+
+private:
+  static size_t select64(uint64_t x, size_t k) noexcept {
+#ifdef __BMI2__
+    return static_cast<size_t>(__builtin_ctzll(_pdep_u64(uint64_t(1) << k, x)));
+#else
+    // narrow down to the byte holding the bit, then clear the bits below it
+    size_t ret = 0;
+    for (size_t width = 32; width >= 8; width /= 2) {
+      const auto low = static_cast<size_t>(
+          __builtin_popcountll(x & ((uint64_t(1) << width) - 1)));
+      if (k >= low) {
+        k -= low;
+        x >>= width;
+        ret += width;
+      }
+    }
+    for (; k > 0; --k) {
+      x &= x - 1;
+    }
+    return ret + static_cast<size_t>(__builtin_ctzll(x));
+#endif
+  }
+
+private:
+  uint64_t lo_ = 0, hi_ = 0;
+};
+
+// all points but the rightmost column, and all but the leftmost column
+constexpr auto MASK_RIGHT = []() constexpr {
+  Bitboard81 ret;
+  for (size_t i = 0; i < 81; ++i) {
+    if (i % 9 != 8) {
+      ret.set(i);
+    }
+  }
+  return ret;
+}();
+constexpr auto MASK_LEFT = MASK_RIGHT << 1;
+
+constexpr Bitboard81 Bitboard81::neighbours() const noexcept {
+  return (*this << 9) | (*this >> 9) | ((*this & MASK_RIGHT) << 1) |
+         ((*this & MASK_LEFT) >> 1);
+}
+
+// 4-neighbourhood of every point
+constexpr auto NEIGHBOURS = []() constexpr {
+  std::array<Bitboard81, 81> ret{};
+  for (size_t i = 0; i < 81; ++i) {
+    ret[i] = Bitboard81::single(i).neighbours();
+  }
+  return ret;
+}();
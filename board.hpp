@@ -1,33 +1,20 @@
 #pragma once
-#include "dset.hpp"
+#include "bitboard.hpp"
 #include <array>
-#include <bitset>
 #include <iostream>
 #include <random>
-#define BIT_TEST _Unchecked_test
-
-const auto MASK_RIGHT = ~std::bitset<81>("100000000"
-                                         "100000000"
-                                         "100000000"
-                                         "100000000"
-                                         "100000000"
-                                         "100000000"
-                                         "100000000"
-                                         "100000000"
-                                         "100000000"),
-           MASK_LEFT = MASK_RIGHT << 1;
 
 class Board {
 public:
-  using board_t = std::bitset<81>;
+  using board_t = Bitboard81;
 
   constexpr size_t operator[](size_t p) const noexcept {
-    return static_cast<size_t>(board_[0][p]) +
-           static_cast<size_t>(board_[1][p]) * 2u;
+    return static_cast<size_t>(board_[0].test(p)) +
+           static_cast<size_t>(board_[1].test(p)) * 2u;
   }
   bool place(size_t bw, size_t p) noexcept {
     // assert(bw == 0 || bw == 1);
-    if (forbid_[bw].BIT_TEST(p)) {
+    if (forbid_[bw].test(p)) {
       return false;
     }
     // place
@@ -35,33 +22,54 @@ public:
     auto &board = board_[bw].set(p), &board_op = board_[1 - bw];
     forbid.set(p);
     forbid_op.set(p);
-    // union
-    auto &dset = dset_[bw], &dset_op = dset_[1 - bw];
-    const size_t dirlen = dir_len_[p];
-    for (size_t i = 0; i < dirlen; ++i) {
-      const size_t x = dir_[p][i];
-      if (board.BIT_TEST(x)) {
-        dset.unions(p, x);
-      }
-    }
+    hash_ ^= zobrist_[bw][p];
+    const auto empty = ~(board | board_op);
     // check current component
-    check_valid(dset, p, board, board_op, forbid, forbid_op);
-    // check neighbors
+    check_valid(p, board, empty, forbid, forbid_op);
+    // check neighbors; an opponent group next to several of them is
+    // checked once
+    board_t checked;
+    const size_t dirlen = dir_len_[p];
     for (size_t i = 0; i < dirlen; ++i) {
       const size_t x = dir_[p][i];
-      if (board_op.BIT_TEST(x)) {
-        check_valid(dset_op, x, board_op, board, forbid_op, forbid);
-      } else if (!board.BIT_TEST(x)) {
-        check_no_liberty(dset_op, x, board_op, board, forbid_op);
+      if (board_op.test(x)) {
+        if (!checked.test(x)) {
+          checked |= check_valid(x, board_op, empty, forbid_op, forbid);
+        }
+      } else if (!board.test(x)) {
+        check_no_liberty(x, board_op, empty, forbid_op);
       }
     }
     return true;
   }
 
+  friend bool operator==(const Board &lhs, const Board &rhs) noexcept {
+    return lhs.board_[0] == rhs.board_[0] && lhs.board_[1] == rhs.board_[1];
+  }
+
+  // Zobrist hash of the stones on the board
+  constexpr uint64_t get_hash() const noexcept { return hash_; }
+  static constexpr uint64_t zobrist(size_t bw, size_t p) noexcept {
+    return zobrist_[bw][p];
+  }
+
   bool has_legal_move(size_t bw) const noexcept { return !forbid_[bw].all(); }
 
   board_t get_legal_moves(size_t bw) const noexcept { return ~forbid_[bw]; }
 
+  constexpr const board_t &get_stones(size_t bw) const noexcept {
+    return board_[bw];
+  }
+
+  // the stones connected to the stone at p
+  board_t get_component(size_t p) const noexcept {
+    return flood(board_t::single(p), board_[board_[1].test(p)]);
+  }
+
+  size_t empty_count() const noexcept {
+    return 81 - (board_[0] | board_[1]).count();
+  }
+
   board_t get_two_go() const noexcept { return ~(forbid_[0] | forbid_[1]); }
 
   template <class PRNG>
@@ -81,16 +89,34 @@ public:
     return random_move_from_board(~forbid_[bw], rng);
   }
 
+  // a legal move of bw, the points open to both sides being drawn with
+  // weight times the chance of the others
+  template <class PRNG>
+  size_t weighted_legal_move(size_t bw, size_t weight,
+                             PRNG &rng) const noexcept {
+    const auto legal = ~forbid_[bw];
+    return weighted_move_from_board(legal, legal & ~forbid_[1 - bw], weight,
+                                    rng);
+  }
+
+  // a point of valid, the points of two_go (a subset of valid) being drawn
+  // with weight times the chance of the others
+  template <class PRNG>
+  static size_t weighted_move_from_board(const board_t &valid,
+                                         const board_t &two_go, size_t weight,
+                                         PRNG &rng) noexcept {
+    // assert(valid.any());
+    const size_t shared = two_go.count() * weight;
+    const size_t x = rng() % (shared + valid.count() - two_go.count());
+    return x < shared ? two_go.select(x / weight)
+                      : (valid & ~two_go).select(x - shared);
+  }
+
   template <class PRNG>
   static size_t random_move_from_board(const board_t &valid,
                                        PRNG &rng) noexcept {
     // assert(valid.any());
-    const size_t index = rng() % valid.count();
-    size_t action = valid._Find_first();
-    for (size_t i = 0; i < index; ++i) {
-      action = valid._Find_next(action);
-    }
-    return action;
+    return valid.select(rng() % valid.count());
   }
 
 public:
@@ -108,50 +134,65 @@ public:
   }
 
 private:
-  static void check_valid(const DisjointSet &dset, size_t p,
-                          const board_t &board, const board_t &board_op,
-                          board_t &forbid, board_t &forbid_op) noexcept {
-    // find component
-    const auto &component = dset.get_component(p);
-    // find liberty
-    const auto &liberty =
-        ((component << 9) | (component >> 9) | ((component & MASK_RIGHT) << 1) |
-         ((component & MASK_LEFT) >> 1)) &
-        ~(board | board_op);
+  // the stones of board connected to seeds
+  static board_t flood(board_t seeds, const board_t &board) noexcept {
+    for (auto grown = seeds;; seeds = grown) {
+      grown |= grown.neighbours() & board;
+      if (grown == seeds) {
+        return seeds;
+      }
+    }
+  }
+
+  // forbids the last liberty of the group of board at p to the opponent,
+  // and to board too when it would have no liberty left; returns the group
+  static board_t check_valid(size_t p, const board_t &board,
+                             const board_t &empty, board_t &forbid,
+                             board_t &forbid_op) noexcept {
+    const auto group = flood(board_t::single(p), board);
+    const auto liberty = group.neighbours() & empty;
     if (liberty.count() == 1) {
-      const size_t x = liberty._Find_first();
+      const size_t x = liberty.find_first();
       forbid_op.set(x);
-      check_no_liberty(dset, x, board, board_op, forbid);
+      check_no_liberty(x, board, empty, forbid);
     }
+    return group;
   }
 
-  static void check_no_liberty(const DisjointSet &dset, size_t x, board_t board,
-                               const board_t &board_op,
+  static void check_no_liberty(size_t x, const board_t &board,
+                               const board_t &empty,
                                board_t &forbid) noexcept {
-    board.set(x);
-    // find component
-    auto component = dset.get_component(x);
-    const size_t dirlen = dir_len_[x];
-    for (size_t i = 0; i < dirlen; ++i) {
-      const size_t y = dir_[x][i];
-      if (board.BIT_TEST(y)) {
-        component |= dset.get_component(y);
-      }
+    // liberties of x joined with the groups next to it
+    if ((NEIGHBOURS[x] & empty).any()) {
+      return;
     }
-    // find liberty
-    const auto &liberty =
-        ((component << 9) | (component >> 9) | ((component & MASK_RIGHT) << 1) |
-         ((component & MASK_LEFT) >> 1)) &
-        ~(board | board_op);
+    auto liberty = flood(NEIGHBOURS[x] & board, board).neighbours() & empty;
+    liberty.reset(x);
     if (liberty.none()) {
       forbid.set(x);
     }
-    // board.reset(x);
   }
 
 private:
+  // the stone groups are flooded from the stones when needed, which keeps
+  // the board small enough to copy for every playout
   board_t board_[2], forbid_[2];
-  DisjointSet dset_[2];
+  uint64_t hash_ = 0x6a09e667f3bcc908ull;
+  const static constexpr auto zobrist_ = []() constexpr {
+    // splitmix64 sequence
+    std::array<std::array<uint64_t, 81>, 2> ret{};
+    uint64_t seed = 0;
+    for (auto &keys : ret) {
+      for (auto &key : keys) {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        key = z ^ (z >> 31);
+      }
+    }
+    return ret;
+  }
+  ();
   const static constexpr auto dir_ = []() constexpr {
     std::array<std::array<size_t, 4>, 81> ret{};
     for (size_t i = 0; i < 81; ++i) {
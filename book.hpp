@@ -0,0 +1,165 @@
+#pragma once
+#include "agent.hpp"
+#include "board.hpp"
+#include "symmetry.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Opening book: a header followed by entries sorted by the canonical key of
+// the position and the side to move. Moves are stored in canonical
+// coordinates, so one entry serves all symmetric positions.
+class OpeningBook {
+public:
+  struct Header {
+    char magic[8];
+    uint64_t size;
+  };
+  struct Entry {
+    uint64_t key;
+    uint64_t move;
+  };
+  static constexpr char magic[8] = {'N', 'O', 'G', 'O', 'B', 'O', 'O', 'K'};
+  static constexpr uint64_t white_key = 0x243f6a8885a308d3ull;
+
+  OpeningBook() = default;
+  OpeningBook(const OpeningBook &) = delete;
+  OpeningBook &operator=(const OpeningBook &) = delete;
+  ~OpeningBook() { close(); }
+
+  bool open(const std::string &path) {
+    close();
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) == 0 &&
+        static_cast<size_t>(st.st_size) >= sizeof(Header)) {
+      length_ = static_cast<size_t>(st.st_size);
+      data_ = ::mmap(nullptr, length_, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+    if (data_ == MAP_FAILED || data_ == nullptr) {
+      data_ = nullptr;
+      return false;
+    }
+    const auto *header = static_cast<const Header *>(data_);
+    if (std::memcmp(header->magic, magic, sizeof(magic)) != 0 ||
+        sizeof(Header) + header->size * sizeof(Entry) > length_) {
+      close();
+      return false;
+    }
+    entries_ = reinterpret_cast<const Entry *>(header + 1);
+    size_ = header->size;
+    return true;
+  }
+
+  void close() noexcept {
+    if (data_ != nullptr) {
+      ::munmap(data_, length_);
+    }
+    data_ = nullptr;
+    entries_ = nullptr;
+    size_ = 0;
+  }
+
+  static uint64_t key(const symmetry::Canonical &canonical,
+                      size_t bw) noexcept {
+    return bw == 0 ? canonical.key : canonical.key ^ white_key;
+  }
+
+  // the book move for bw, or 81 when the position is out of book
+  size_t probe(const Board &b, size_t bw) const noexcept {
+    if (size_ == 0) {
+      return 81;
+    }
+    const auto canonical = symmetry::canonical(b);
+    const uint64_t k = key(canonical, bw);
+    const auto *end = entries_ + size_;
+    const auto *entry = std::lower_bound(
+        entries_, end, k,
+        [](const Entry &e, uint64_t value) { return e.key < value; });
+    if (entry == end || entry->key != k || entry->move >= 81) {
+      return 81;
+    }
+    const size_t move = symmetry::from_canonical(
+        static_cast<size_t>(entry->move), canonical.symmetry);
+    return b.get_legal_moves(bw).test(move) ? move : 81;
+  }
+
+  static bool write(const std::string &path,
+                    const std::map<uint64_t, uint64_t> &entries) {
+    std::ofstream out(path, std::ios::binary);
+    Header header{};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.size = entries.size();
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (const auto &[k, move] : entries) {
+      const Entry entry{k, move};
+      out.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+    }
+    return static_cast<bool>(out);
+  }
+
+private:
+  void *data_ = nullptr;
+  size_t length_ = 0;
+  const Entry *entries_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Searches every position up to the given number of plies, following the
+// `width` most visited replies of each search, and writes the best moves.
+inline bool build_book(const std::string &path, const MCTSConfig &config,
+                       size_t plies, size_t width,
+                       std::chrono::milliseconds budget) {
+  MCTSAgent agent(config);
+  std::map<uint64_t, uint64_t> entries;
+  std::vector<std::pair<Board, size_t>> frontier{{Board{}, 0}};
+  for (size_t ply = 0; ply < plies && !frontier.empty(); ++ply) {
+    std::vector<std::pair<Board, size_t>> next;
+    for (const auto &[b, bw] : frontier) {
+      const auto canonical = symmetry::canonical(b);
+      const uint64_t key = OpeningBook::key(canonical, bw);
+      if (entries.count(key) > 0) {
+        continue;
+      }
+      const size_t move = agent.take_action(b, bw, budget, 0);
+      if (move >= 81) {
+        continue;
+      }
+      entries.emplace(key, symmetry::to_canonical(move, canonical.symmetry));
+      std::cerr << "ply " << ply << ": " << entries.size() << " positions"
+                << std::endl;
+      std::unordered_map<size_t, size_t> visits;
+      agent.get_children_visits(visits);
+      std::vector<std::pair<size_t, size_t>> replies(std::begin(visits),
+                                                     std::end(visits));
+      std::sort(std::begin(replies), std::end(replies),
+                [](const auto &p1, const auto &p2) {
+                  return p1.second > p2.second;
+                });
+      replies.resize(std::min(replies.size(), width));
+      for (const auto &reply : replies) {
+        Board nb(b);
+        nb.place(bw, reply.first);
+        next.emplace_back(nb, 1 - bw);
+      }
+    }
+    frontier = std::move(next);
+  }
+  return OpeningBook::write(path, entries);
+}
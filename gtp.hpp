@@ -1,41 +1,24 @@
 #pragma once
 #include "agent.hpp"
 #include "board.hpp"
+#include "book.hpp"
+#include "position.hpp"
+#include "timer.hpp"
+#include "workers.hpp"
 #include <algorithm>
 #include <array>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
 #include <iterator>
 #include <memory>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
 #include <vector>
 
-struct Position {
-  Position() = default;
-  Position(const Position &) = default;
-  Position(Position &&) noexcept = default;
-  explicit Position(size_t p) : p0(p % 9), p1(p / 9) {}
-  explicit operator size_t() const { return p0 + p1 * 9; }
-  Position &operator=(const Position &) = default;
-  Position &operator=(Position &&) noexcept = default;
-  ~Position() = default;
-
-  friend std::istream &operator>>(std::istream &in, Position &p) {
-    std::string ipos;
-    in >> ipos;
-    // assert(ipos.size() == 2);
-    auto pp0 = static_cast<size_t>(tolower(ipos[0]) - 'a');
-    p.p0 = pp0 > 8 ? pp0 - 1 : pp0;
-    p.p1 = static_cast<size_t>(8 - (ipos[1] - '1'));
-    return in;
-  }
-  friend std::ostream &operator<<(std::ostream &out, const Position &p) {
-    out << char(static_cast<size_t>(p.p0 >= 8) + p.p0 + 'A')
-        << char((8 - p.p1) + '1');
-    return out;
-  }
-
-  size_t p0, p1;
-};
-
 namespace detail {
 constexpr uint32_t fnv1a_32(const char *s, size_t count) {
   // FNV-1a 32bit hashing algorithm.
@@ -69,6 +52,13 @@ public:
   bool execute() {
     std::string cmd;
     std::cin >> cmd;
+    agent_->stop();
+    if (analyzing_) {
+      // any command ends the analysis
+      agent_->set_reporter({}, {});
+      std::cout << "\n";
+      analyzing_ = false;
+    }
     const auto cmd_hash = detail::fnv1a_32(cmd.c_str(), cmd.size());
     switch (cmd_hash) {
     // Adminstrative Commands
@@ -110,6 +100,12 @@ public:
       undo();
       break;
     // Tournament Commands
+    case "time_settings"_hash:
+      time_settings();
+      break;
+    case "time_left"_hash:
+      time_left();
+      break;
     case "final_score"_hash:
       final_score();
       break;
@@ -117,6 +113,16 @@ public:
     case "showboard"_hash:
       showboard();
       break;
+    case "search_stats"_hash:
+      search_stats();
+      break;
+    // Analysis Commands
+    case "lz-analyze"_hash:
+      lz_analyze();
+      break;
+    case "lz-genmove_analyze"_hash:
+      lz_genmove_analyze();
+      break;
     // GoGui Commands
     /*case "gogui-rules_game_id"_hash:
       gogui_rules_game_id();
@@ -143,7 +149,15 @@ public:
     return true;
   }
 
-  void registerAgent() { agent_ = std::make_unique<MCTSAgent>(); }
+  void registerAgent(const MCTSConfig &config) {
+    agent_ = std::make_unique<MCTSAgent>(config);
+  }
+  bool registerBook(const std::string &path) { return book_.open(path); }
+  // genmove also searches in worker processes; forks them, so call it
+  // before any search
+  void registerWorkers(const MCTSConfig &config, size_t workers) {
+    workers_ = std::make_unique<WorkerPool>(config, workers);
+  }
 
 private:
   /* Adminstrative Commands */
@@ -182,6 +196,8 @@ private:
     Board b;
     std::swap(board_, b);
     history_.clear();
+    agent_->new_game();
+    timer_.reset();
     gogui_turns_ = true;
     std::cout << "=\n\n";
   }
@@ -202,6 +218,7 @@ private:
     if (board_.place(bw, static_cast<size_t>(pos))) {
       std::cout << "=\n\n";
       history_.push_back(board_);
+      agent_->play(bw, static_cast<size_t>(pos));
       gogui_turns_ = !gogui_turns_;
     } else {
       std::cout << "? illegal move\n\n";
@@ -211,28 +228,104 @@ private:
     std::string sbw;
     std::cin >> sbw;
     auto bw = static_cast<size_t>(tolower(sbw[0]) == 'w');
-    auto move = agent_->take_action(board_, bw);
+    const size_t move = think(bw);
     if (move < 81) {
-      std::cout << "= " << Position(move) << "\n\n";
-      board_.place(bw, move);
-      history_.push_back(board_);
+      std::cout << "= " << Position(move) << "\n\n" << std::flush;
+      make_move(bw, move);
     } else {
       std::cout << "= resign\n\n";
     }
   }
+  // the move of bw from the book or the search, on the clock
+  size_t think(size_t bw) {
+    const auto start_time = std::chrono::steady_clock::now();
+    auto move = book_.probe(board_, bw);
+    if (move >= 81) {
+      const TimeManager::duration budget =
+          timer_.enabled() ? timer_.budget(board_, bw)
+                           : MCTSAgent::threshold_time;
+      const size_t min_simulations =
+          timer_.enabled() ? 0 : MCTSAgent::threshold_simulations;
+      if (workers_ != nullptr) {
+        workers_->start(board_, bw, budget, min_simulations);
+      }
+      move = agent_->take_action(board_, bw, budget, min_simulations);
+      if (workers_ != nullptr) {
+        // the workers get until the end of the budget, or twice as long
+        // without a clock since they also play min_simulations
+        const auto deadline =
+            std::max(std::chrono::steady_clock::now(), start_time + budget) +
+            (timer_.enabled() ? TimeManager::margin / 2 : budget);
+        move = merge(move, deadline);
+      }
+    }
+    timer_.spend(bw, std::chrono::duration_cast<TimeManager::duration>(
+                         std::chrono::steady_clock::now() - start_time));
+    return move;
+  }
+  // the most visited root child over this process and the workers, unless
+  // a search proved a win
+  size_t merge(size_t move, std::chrono::steady_clock::time_point deadline) {
+    std::unordered_map<size_t, size_t> visits;
+    agent_->get_children_visits(visits);
+    const size_t solved = workers_->collect(visits, deadline);
+    if (agent_->get_stats().solved) {
+      return move;
+    }
+    if (solved < 81) {
+      return solved;
+    }
+    if (visits.empty()) {
+      return move;
+    }
+    return std::max_element(std::begin(visits), std::end(visits),
+                            [](const auto &p1, const auto &p2) {
+                              return p1.second < p2.second;
+                            })
+        ->first;
+  }
+  void make_move(size_t bw, size_t move) {
+    board_.place(bw, move);
+    history_.push_back(board_);
+    agent_->play(bw, move);
+    gogui_turns_ = !gogui_turns_;
+    agent_->ponder(board_, 1 - bw);
+  }
   void undo() {
     if (history_.empty()) {
       std::cout << "? cannot undo\n\n";
       return;
     }
-    board_ = history_.back();
     history_.pop_back();
+    board_ = history_.empty() ? Board{} : history_.back();
+    agent_->reset();
+    gogui_turns_ = !gogui_turns_;
     std::cout << "=\n\n";
   }
 
 private:
   /* Tournament Commands */
-  // void time_settings() { ; }
+  void time_settings() {
+    double main_time, byo_yomi_time;
+    size_t byo_yomi_stones;
+    std::cin >> main_time >> byo_yomi_time >> byo_yomi_stones;
+    timer_.settings(to_duration(main_time), to_duration(byo_yomi_time),
+                    byo_yomi_stones);
+    std::cout << "=\n\n";
+  }
+  void time_left() {
+    std::string sbw;
+    double time;
+    size_t stones;
+    std::cin >> sbw >> time >> stones;
+    auto bw = static_cast<size_t>(tolower(sbw[0]) == 'w');
+    timer_.left(bw, to_duration(time), stones);
+    std::cout << "=\n\n";
+  }
+  static TimeManager::duration to_duration(double seconds) {
+    return std::chrono::duration_cast<TimeManager::duration>(
+        std::chrono::duration<double>(seconds));
+  }
   void final_score() const {
     std::cout << "= " << (!gogui_turns_ ? "B" : "W") << "+1\n\n";
   }
@@ -245,6 +338,82 @@ private:
 private:
   /* Debug Commands */
   void showboard() const { std::cout << "=\n" << board_; }
+  // statistics of the last genmove search
+  void search_stats() const {
+    std::cout << "=\n" << agent_->get_stats() << "\n";
+  }
+
+private:
+  /* Analysis Commands */
+  // lz-analyze [color] [interval]: searches until the next command, with
+  // the root children reported every interval centiseconds
+  void lz_analyze() {
+    const size_t bw = read_analysis_args();
+    std::cout << "=\n" << std::flush;
+    analyzing_ = true;
+    agent_->analyze(board_, bw);
+  }
+  // lz-genmove_analyze [color] [interval]: genmove reporting as lz-analyze
+  void lz_genmove_analyze() {
+    const size_t bw = read_analysis_args();
+    std::cout << "=\n" << std::flush;
+    const size_t move = think(bw);
+    agent_->set_reporter({}, {});
+    if (move < 81) {
+      std::cout << "play " << Position(move) << "\n\n" << std::flush;
+      make_move(bw, move);
+    } else {
+      std::cout << "play resign\n\n" << std::flush;
+    }
+  }
+  // sets the reporter from the rest of the line and returns the color,
+  // the side to move by default
+  size_t read_analysis_args() {
+    std::string line, arg;
+    std::getline(std::cin, line);
+    std::istringstream in(line);
+    size_t bw = gogui_turns_ ? 0 : 1;
+    long centiseconds = 100;
+    while (in >> arg) {
+      const char c = static_cast<char>(tolower(arg[0]));
+      if (c == 'b' || c == 'w') {
+        bw = static_cast<size_t>(c == 'w');
+      } else if (arg == "interval") {
+        in >> centiseconds;
+      } else if (std::isdigit(static_cast<unsigned char>(arg[0]))) {
+        centiseconds = std::strtol(arg.c_str(), nullptr, 10);
+      }
+    }
+    agent_->set_reporter(std::chrono::milliseconds(
+                             std::max<long>(centiseconds, 1) * 10),
+                         report_analysis);
+    return bw;
+  }
+  // one line of "info move" entries; written past std::cout, which belongs
+  // to the thread reading the commands
+  static void report_analysis(const SearchStats &stats) {
+    std::ostringstream out;
+    for (size_t i = 0; i < stats.children.size(); ++i) {
+      const auto &child = stats.children[i];
+      out << (i > 0 ? " " : "") << "info move " << Position(child.pos)
+          << " visits " << child.visits << " winrate "
+          << static_cast<int>(child.win_rate * 10000.) << " order " << i
+          << " pv";
+      for (const size_t p : child.pv) {
+        out << " " << Position(p);
+      }
+    }
+    out << "\n";
+    const std::string text = out.str();
+    for (size_t written = 0; written < text.size();) {
+      const ssize_t n =
+          ::write(STDOUT_FILENO, text.data() + written, text.size() - written);
+      if (n <= 0) {
+        break;
+      }
+      written += static_cast<size_t>(n);
+    }
+  }
 
 private:
   /* GoGui Rules */
@@ -256,7 +425,7 @@ private:
     size_t bw = gogui_turns_ ? 0 : 1;
     std::cout << "=";
     auto moves = board_.get_legal_moves(bw);
-    for (size_t p = moves._Find_first(); p != 81; p = moves._Find_next(p)) {
+    for (const size_t p : moves) {
       std::cout << " " << Position(p);
     }
     std::cout << "\n\n";
@@ -270,10 +439,16 @@ private:
 
 private:
   std::unique_ptr<MCTSAgent> agent_;
+  // processes searching along with agent_ in genmove, or nullptr
+  std::unique_ptr<WorkerPool> workers_;
+  OpeningBook book_;
   Board board_;
   std::vector<Board> history_;
+  TimeManager timer_;
   bool gogui_turns_ = true;
-  static const constexpr std::array<const char *, 14> all_commands_ = {
+  // an lz-analyze response is open until the next command
+  bool analyzing_ = false;
+  static const constexpr std::array<const char *, 19> all_commands_ = {
       // Adminstrative Commands
       "quit", "protocol_version", "name", "version", "known_command",
       "list_commands",
@@ -282,9 +457,11 @@ private:
       // Setup Commands
       "boardsize", "clear_board", "komi",
       // Tournament Commands
-      "final_score",
+      "time_settings", "time_left", "final_score",
       // Debug Commands
-      "showboard",
+      "showboard", "search_stats",
+      // Analysis Commands
+      "lz-analyze", "lz-genmove_analyze",
       // GoGui Commands
       /*"gogui-rules_game_id", "gogui-rules_board", "gogui-rules_board_size",
       "gogui-rules_legal_moves", "gogui-rules_side_to_move",
@@ -0,0 +1,222 @@
+#pragma once
+#include "agent.hpp"
+#include "board.hpp"
+#include "random.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One side of a self-play match: an MCTSAgent searching a fixed number of
+// simulations or a fixed time per move, or a RandomAgent.
+struct MatchPlayer {
+  bool random = false;
+  MCTSConfig config;
+  size_t simulations = 10000;
+  // per move, overrides simulations when non-zero
+  std::chrono::milliseconds time{0};
+
+  // "random", or "mcts" followed by ",key=value" overrides of this player
+  // for threads, memory, tt, batch, solve, shared_weight, widening,
+  // simulations and time (seconds)
+  std::optional<MatchPlayer> parse(const std::string &spec) const {
+    std::istringstream in(spec);
+    std::string token;
+    std::getline(in, token, ',');
+    MatchPlayer ret(*this);
+    if (token == "random") {
+      ret.random = true;
+      return in.eof() ? std::optional(ret) : std::nullopt;
+    }
+    if (token != "mcts") {
+      return std::nullopt;
+    }
+    while (std::getline(in, token, ',')) {
+      const size_t eq = token.find('=');
+      if (eq == std::string::npos) {
+        return std::nullopt;
+      }
+      const std::string key = token.substr(0, eq);
+      const char *value = token.c_str() + eq + 1;
+      if (key == "threads") {
+        ret.config.threads = std::strtoul(value, nullptr, 10);
+      } else if (key == "memory") {
+        ret.config.memory = std::strtoul(value, nullptr, 10);
+      } else if (key == "tt") {
+        ret.config.tt = std::strtoul(value, nullptr, 10);
+      } else if (key == "batch") {
+        ret.config.batch = std::strtoul(value, nullptr, 10);
+      } else if (key == "solve") {
+        ret.config.solve = std::strtoul(value, nullptr, 10);
+      } else if (key == "shared_weight") {
+        ret.config.shared_weight = std::strtoul(value, nullptr, 10);
+      } else if (key == "widening") {
+        ret.config.widening = std::strtoul(value, nullptr, 10);
+      } else if (key == "simulations") {
+        ret.simulations = std::strtoul(value, nullptr, 10);
+      } else if (key == "time") {
+        ret.time = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::duration<double>(std::strtod(value, nullptr)));
+      } else {
+        return std::nullopt;
+      }
+    }
+    return ret;
+  }
+};
+
+// Sequential probability ratio test of the hypotheses that player A is elo0
+// or elo1 stronger than player B, from a win/loss record.
+struct SPRT {
+  double elo0 = 0., elo1 = 30., alpha = .05, beta = .05;
+
+  static double expected_score(double elo) noexcept {
+    return 1. / (1. + std::pow(10., -elo / 400.));
+  }
+  double llr(size_t wins, size_t losses) const noexcept {
+    const double p0 = expected_score(elo0), p1 = expected_score(elo1);
+    return static_cast<double>(wins) * std::log(p1 / p0) +
+           static_cast<double>(losses) * std::log((1. - p1) / (1. - p0));
+  }
+  double lower() const noexcept { return std::log(beta / (1. - alpha)); }
+  double upper() const noexcept { return std::log((1. - beta) / alpha); }
+  // -1 accepts elo0, 1 accepts elo1, 0 needs more games
+  int decide(size_t wins, size_t losses) const noexcept {
+    const double ratio = llr(wins, losses);
+    return ratio >= upper() ? 1 : ratio <= lower() ? -1 : 0;
+  }
+};
+
+class Match {
+public:
+  Match(const MatchPlayer &a, const MatchPlayer &b, const SPRT &sprt,
+        uint64_t seed)
+      : players_{a, b}, sprt_(sprt), seed_(seed) {
+    for (auto &player : players_) {
+      player.config.ponder = false;
+      player.config.verbose = false;
+    }
+  }
+
+  // play up to games games on jobs threads; A is black in the even games
+  void run(size_t games, size_t jobs) {
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < std::max<size_t>(jobs, 1); ++i) {
+      threads.emplace_back([this, games] {
+        for (size_t game = next_.fetch_add(1); game < games && !stop_;
+             game = next_.fetch_add(1)) {
+          const size_t a_bw = game % 2;
+          const size_t winner = play_game(game, a_bw);
+          record(game, winner == a_bw);
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+
+  // win rate of A, Elo difference with 95% error bars and SPRT state
+  void report(std::ostream &out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const size_t games = wins_ + losses_;
+    const double n = static_cast<double>(games);
+    const double score = games == 0 ? .5 : static_cast<double>(wins_) / n;
+    // Wilson interval, which stays meaningful for lopsided results
+    const double z2 = games == 0 ? 0. : 1.959964 * 1.959964 / n;
+    const double center = (score + z2 / 2.) / (1. + z2);
+    const double margin =
+        games == 0 ? .5
+                   : std::sqrt(z2 * score * (1. - score) + z2 * z2 / 4.) /
+                         (1. + z2);
+    const int decision = sprt_.decide(wins_, losses_);
+    out << "games " << games << ": " << wins_ << " - " << losses_
+        << ", win rate " << score * 100. << "%, elo " << elo(score) << " ["
+        << elo(center - margin) << ", " << elo(center + margin)
+        << "], sprt llr " << sprt_.llr(wins_, losses_) << " ["
+        << sprt_.lower() << ", " << sprt_.upper() << "] "
+        << (decision > 0   ? "H1 accepted"
+            : decision < 0 ? "H0 accepted"
+                           : "undecided")
+        << std::endl;
+  }
+
+private:
+  static double elo(double score) noexcept {
+    score = std::clamp(score, 1e-3, 1. - 1e-3);
+    return -400. * std::log10(1. / score - 1.);
+  }
+
+  size_t play_game(size_t game, size_t a_bw) const {
+    // a fresh pair of agents per game keeps the games independent
+    splitmix seeds(seed_ + game);
+    std::unique_ptr<MCTSAgent> mcts[2];
+    std::unique_ptr<RandomAgent> random[2];
+    for (size_t i = 0; i < 2; ++i) {
+      const auto &player = players_[i];
+      const size_t bw = i == 0 ? a_bw : 1 - a_bw;
+      if (player.random) {
+        random[bw] = std::make_unique<RandomAgent>(seeds());
+      } else {
+        MCTSConfig config(player.config);
+        config.seed = seeds();
+        mcts[bw] = std::make_unique<MCTSAgent>(config);
+      }
+    }
+    Board b;
+    size_t bw = 0;
+    for (; b.has_legal_move(bw); bw = 1 - bw) {
+      size_t move;
+      if (random[bw] != nullptr) {
+        move = random[bw]->take_action(b, bw);
+      } else {
+        const auto &player = players_[bw == a_bw ? 0 : 1];
+        move = player.time.count() > 0
+                   ? mcts[bw]->take_action(b, bw, player.time, 0)
+                   : mcts[bw]->take_action(b, bw,
+                                           MCTSAgent::hclock::duration::zero(),
+                                           player.simulations);
+      }
+      b.place(bw, move);
+      for (auto &agent : mcts) {
+        if (agent != nullptr) {
+          agent->play(bw, move);
+        }
+      }
+    }
+    // the side to move has no legal move and loses
+    return 1 - bw;
+  }
+
+  void record(size_t game, bool a_wins) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      (a_wins ? wins_ : losses_) += 1;
+      if (sprt_.decide(wins_, losses_) != 0) {
+        stop_ = true;
+      }
+      std::cerr << "game " << game << ": " << (a_wins ? "A" : "B")
+                << " wins as "
+                << (a_wins == (game % 2 == 0) ? "black" : "white") << std::endl;
+    }
+    report(std::cerr);
+  }
+
+private:
+  MatchPlayer players_[2];
+  SPRT sprt_;
+  uint64_t seed_;
+  std::atomic<size_t> next_{0};
+  std::atomic<bool> stop_{false};
+  mutable std::mutex mutex_;
+  size_t wins_ = 0, losses_ = 0;
+};
@@ -1,10 +1,126 @@
 #include "agent.hpp"
+#include "book.hpp"
 #include "gtp.hpp"
+#include "match.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
 
-int main(int /*argc*/, char ** /*argv*/) {
+int main(int argc, char **argv) {
+  MCTSConfig config;
+  std::string book, build_book_path;
+  size_t book_plies = 6, book_width = 3;
+  double book_time = 10.;
+  size_t arena_games = 0, arena_jobs = 0, workers = 0;
+  std::string vs = "random";
+  MatchPlayer player;
+  SPRT sprt;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg(argv[i]);
+    if ((arg == "-t" || arg == "--threads") && i + 1 < argc) {
+      config.threads = std::strtoul(argv[++i], nullptr, 10);
+    } else if ((arg == "-m" || arg == "--memory") && i + 1 < argc) {
+      config.memory = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--workers" && i + 1 < argc) {
+      workers = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "-p" || arg == "--ponder") {
+      config.ponder = true;
+    } else if (arg == "--tt" && i + 1 < argc) {
+      config.tt = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--book" && i + 1 < argc) {
+      book = argv[++i];
+    } else if (arg == "--build-book" && i + 1 < argc) {
+      build_book_path = argv[++i];
+    } else if (arg == "--book-plies" && i + 1 < argc) {
+      book_plies = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--book-width" && i + 1 < argc) {
+      book_width = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--book-time" && i + 1 < argc) {
+      book_time = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--shared-weight" && i + 1 < argc) {
+      config.shared_weight = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--widening" && i + 1 < argc) {
+      config.widening = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--batch" && i + 1 < argc) {
+      config.batch = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--solve" && i + 1 < argc) {
+      config.solve = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--log" && i + 1 < argc) {
+      config.log = argv[++i];
+    } else if (arg == "--seed" && i + 1 < argc) {
+      config.seed = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--arena" && i + 1 < argc) {
+      arena_games = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--vs" && i + 1 < argc) {
+      vs = argv[++i];
+    } else if (arg == "--jobs" && i + 1 < argc) {
+      arena_jobs = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--simulations" && i + 1 < argc) {
+      player.simulations = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--move-time" && i + 1 < argc) {
+      player.time = std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::duration<double>(std::strtod(argv[++i], nullptr)));
+    } else if (arg == "--sprt" && i + 2 < argc) {
+      sprt.elo0 = std::strtod(argv[++i], nullptr);
+      sprt.elo1 = std::strtod(argv[++i], nullptr);
+    } else {
+      std::cerr << "usage: " << argv[0]
+                << " [-t|--threads N] [-m|--memory MB] [--workers N]"
+                   " [-p|--ponder] [--tt MB] [--batch N] [--solve N]"
+                   " [--book FILE]"
+                   " [--shared-weight N] [--widening N] [--log FILE]\n"
+                   "       "
+                << argv[0]
+                << " --build-book FILE [--book-plies N] [--book-width N]"
+                   " [--book-time SEC] [search options]\n"
+                   "       "
+                << argv[0]
+                << " --arena GAMES [--vs random|mcts[,key=value...]]"
+                   " [--jobs N] [--simulations N] [--move-time SEC]"
+                   " [--sprt ELO0 ELO1] [--seed N] [search options]"
+                << std::endl;
+      return 1;
+    }
+  }
+  if (!build_book_path.empty()) {
+    const auto budget = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::duration<double>(book_time));
+    return build_book(build_book_path, config, book_plies, book_width, budget)
+               ? 0
+               : 1;
+  }
+  if (arena_games > 0) {
+    player.config = config;
+    const auto opponent = player.parse(vs);
+    if (!opponent) {
+      std::cerr << "invalid opponent " << vs << std::endl;
+      return 1;
+    }
+    // one game per core unless the agents search on several threads
+    const size_t jobs =
+        arena_jobs > 0
+            ? arena_jobs
+            : std::max<size_t>(std::thread::hardware_concurrency() /
+                                   std::max<size_t>(config.threads, 1),
+                               1);
+    Match match(player, *opponent, sprt, config.seed);
+    match.run(arena_games, jobs);
+    match.report(std::cout);
+    return 0;
+  }
   auto &gtp = GTPHelper::getInstance();
-  gtp.registerAgent();
+  gtp.registerAgent(config);
+  if (workers > 0) {
+    gtp.registerWorkers(config, workers);
+  }
+  if (!book.empty() && !gtp.registerBook(book)) {
+    std::cerr << "cannot load opening book " << book << std::endl;
+    return 1;
+  }
   while (gtp.execute()) {
     ;
   }
-}
\ No newline at end of file
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cctype>
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+// A point in GTP coordinates: columns A to J without I, rows 9 to 1 from
+// the top.
+struct Position {
+  Position() = default;
+  Position(const Position &) = default;
+  Position(Position &&) noexcept = default;
+  explicit Position(size_t p) : p0(p % 9), p1(p / 9) {}
+  explicit operator size_t() const { return p0 + p1 * 9; }
+  Position &operator=(const Position &) = default;
+  Position &operator=(Position &&) noexcept = default;
+  ~Position() = default;
+
+  friend std::istream &operator>>(std::istream &in, Position &p) {
+    std::string ipos;
+    in >> ipos;
+    // assert(ipos.size() == 2);
+    auto pp0 = static_cast<size_t>(tolower(ipos[0]) - 'a');
+    p.p0 = pp0 > 8 ? pp0 - 1 : pp0;
+    p.p1 = static_cast<size_t>(8 - (ipos[1] - '1'));
+    return in;
+  }
+  friend std::ostream &operator<<(std::ostream &out, const Position &p) {
+    out << char(static_cast<size_t>(p.p0 >= 8) + p.p0 + 'A')
+        << char((8 - p.p1) + '1');
+    return out;
+  }
+
+  size_t p0, p1;
+};
@@ -0,0 +1,111 @@
+#pragma once
+#include "board.hpp"
+#include "tt.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Exact solver for late positions: depth-first negamax over the legal
+// moves, trying first the moves that leave the opponent the fewest replies.
+// Proven results are kept in a table indexed by Zobrist hash, allocated by
+// the first call to solve.
+class Solver {
+public:
+  using clock = std::chrono::steady_clock;
+  enum Result : uint8_t { UNKNOWN, WIN, LOSS };
+
+  explicit Solver(size_t log2_entries = 20)
+      : entries_(size_t(1) << log2_entries) {}
+
+  // whether bw to move wins b and with which move; UNKNOWN once the
+  // deadline passes before the position is proven
+  Result solve(const Board &b, size_t bw, clock::time_point deadline,
+               size_t &move) {
+    if (table_.empty()) {
+      table_.resize(entries_);
+    }
+    deadline_ = deadline;
+    aborted_ = false;
+    nodes_ = 0;
+    move = 81;
+    return search(b, bw, move);
+  }
+
+  size_t nodes() const noexcept { return nodes_; }
+
+private:
+  // nodes searched between checks of the deadline
+  const static constexpr size_t check_interval = 4096;
+
+  struct Entry {
+    uint64_t key = 0;
+    uint8_t result = UNKNOWN, move = 81;
+  };
+
+  static uint64_t key(const Board &b, size_t bw) noexcept {
+    return bw == 0 ? b.get_hash() : b.get_hash() ^ TranspositionTable::side_key;
+  }
+
+  Result search(const Board &b, size_t bw, size_t &move) {
+    if (++nodes_ % check_interval == 0 && clock::now() >= deadline_) {
+      aborted_ = true;
+    }
+    if (aborted_) {
+      return UNKNOWN;
+    }
+    const uint64_t k = key(b, bw);
+    auto &entry = table_[k & (table_.size() - 1)];
+    if (entry.key == k && entry.result != UNKNOWN) {
+      move = entry.move;
+      return static_cast<Result>(entry.result);
+    }
+    // order the moves by the mobility left to the opponent
+    std::array<std::pair<size_t, uint8_t>, 81> order;
+    size_t size = 0;
+    for (const size_t p : b.get_legal_moves(bw)) {
+      Board child(b);
+      child.place(bw, p);
+      const size_t replies = child.get_legal_moves(1 - bw).count();
+      const auto &known = table_[key(child, 1 - bw) & (table_.size() - 1)];
+      if (replies == 0 ||
+          (known.key == key(child, 1 - bw) && known.result == LOSS)) {
+        return store(entry, k, WIN, p, move);
+      }
+      order[size++] = {replies * 81 + 81 - child.get_legal_moves(bw).count(),
+                       static_cast<uint8_t>(p)};
+    }
+    std::sort(std::begin(order), std::begin(order) + size);
+    for (size_t i = 0; i < size; ++i) {
+      const size_t p = order[i].second;
+      Board child(b);
+      child.place(bw, p);
+      size_t reply;
+      const Result result = search(child, 1 - bw, reply);
+      if (result == LOSS) {
+        return store(entry, k, WIN, p, move);
+      }
+      if (result == UNKNOWN) {
+        return UNKNOWN;
+      }
+    }
+    return store(entry, k, LOSS, 81, move);
+  }
+
+  static Result store(Entry &entry, uint64_t k, Result result, size_t p,
+                      size_t &move) noexcept {
+    entry.key = k;
+    entry.result = result;
+    entry.move = static_cast<uint8_t>(p);
+    move = p;
+    return result;
+  }
+
+  size_t entries_;
+  std::vector<Entry> table_;
+  clock::time_point deadline_;
+  size_t nodes_ = 0;
+  bool aborted_ = false;
+};
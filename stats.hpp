@@ -0,0 +1,160 @@
+#pragma once
+#include "position.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+// Counters of one search thread, padded to a cache line of its own. Phases
+// are only timed every sample_interval simulations to keep the clock cheap.
+struct alignas(64) ThreadStats {
+  using clock = std::chrono::steady_clock;
+  const static constexpr size_t sample_interval = 64;
+  enum Phase : size_t { SELECTION, EXPANSION, PLAYOUT, BACKPROP, PHASES };
+
+  // start a descent with n playouts; returns whether its phases are timed
+  bool begin(clock::time_point &t, size_t n) noexcept {
+    const bool sampled = descents++ % sample_interval == 0;
+    simulations += n;
+    if (sampled) {
+      t = clock::now();
+    }
+    return sampled;
+  }
+  void lap(bool sampled, Phase phase, clock::time_point &t) noexcept {
+    if (sampled) {
+      const auto now = clock::now();
+      phase_time[phase] += now - t;
+      t = now;
+    }
+  }
+  void depth(size_t d) noexcept {
+    depth_sum += d;
+    max_depth = std::max(max_depth, d);
+  }
+
+  size_t descents = 0, simulations = 0, depth_sum = 0, max_depth = 0;
+  // nodes created since the tree was last compacted
+  size_t nodes = 0;
+  std::array<clock::duration, PHASES> phase_time{};
+};
+
+// Summary of one search, printed by the search_stats GTP command and
+// written as a JSON line to the search log.
+struct SearchStats {
+  struct Child {
+    size_t pos, visits;
+    double win_rate;
+    // starting with pos
+    std::vector<size_t> pv;
+  };
+
+  void add(const ThreadStats &stats) noexcept {
+    descents += stats.descents;
+    simulations += stats.simulations;
+    depth_sum += stats.depth_sum;
+    max_depth = std::max(max_depth, stats.max_depth);
+    nodes += stats.nodes;
+    for (size_t i = 0; i < ThreadStats::PHASES; ++i) {
+      phase_time[i] += stats.phase_time[i];
+    }
+  }
+  double simulations_per_second() const noexcept {
+    return elapsed.count() > 0 ? static_cast<double>(simulations) * 1e3 /
+                                     static_cast<double>(elapsed.count())
+                               : 0.;
+  }
+  double average_depth() const noexcept {
+    return descents > 0 ? static_cast<double>(depth_sum) /
+                              static_cast<double>(descents)
+                        : 0.;
+  }
+  // fraction of the sampled time spent in phase
+  double phase_share(size_t phase) const noexcept {
+    ThreadStats::clock::duration total{0};
+    for (const auto &t : phase_time) {
+      total += t;
+    }
+    return total.count() > 0 ? static_cast<double>(phase_time[phase].count()) /
+                                   static_cast<double>(total.count())
+                             : 0.;
+  }
+
+  friend std::ostream &operator<<(std::ostream &out, const SearchStats &s) {
+    out << "time " << s.elapsed.count() << " ms\n";
+    if (s.solved) {
+      out << "solved win";
+      if (!s.pv.empty()) {
+        out << " " << Position(s.pv.front());
+      }
+      out << "\n";
+      if (s.descents == 0) {
+        return out;
+      }
+    }
+    out << "simulations " << s.simulations << " (" << s.reused << " reused)\n"
+        << "simulations/s " << s.simulations_per_second() << "\n"
+        << "depth " << s.average_depth() << " avg, " << s.max_depth
+        << " max\n"
+        << "nodes " << s.nodes << " (" << s.bytes / 1024 << " KiB, "
+        << s.collections << " collections)\n"
+        << "phases";
+    for (size_t i = 0; i < ThreadStats::PHASES; ++i) {
+      out << " " << phase_names[i] << " " << s.phase_share(i) * 100. << "%";
+    }
+    out << "\npv";
+    for (const size_t p : s.pv) {
+      out << " " << Position(p);
+    }
+    for (const auto &child : s.children) {
+      out << "\n" << Position(child.pos) << " " << child.visits << " visits "
+          << child.win_rate * 100. << "%";
+    }
+    return out << "\n";
+  }
+
+  void write_json(std::ostream &out) const {
+    out << "{\"time_ms\":" << elapsed.count()
+        << ",\"solved\":" << (solved ? "true" : "false")
+        << ",\"simulations\":" << simulations << ",\"reused\":" << reused
+        << ",\"simulations_per_sec\":" << simulations_per_second()
+        << ",\"avg_depth\":" << average_depth()
+        << ",\"max_depth\":" << max_depth << ",\"nodes\":" << nodes
+        << ",\"bytes\":" << bytes << ",\"collections\":" << collections
+        << ",\"phases\":{";
+    for (size_t i = 0; i < ThreadStats::PHASES; ++i) {
+      out << (i > 0 ? "," : "") << "\"" << phase_names[i]
+          << "\":" << phase_share(i);
+    }
+    out << "},\"pv\":[";
+    for (size_t i = 0; i < pv.size(); ++i) {
+      out << (i > 0 ? "," : "") << "\"" << Position(pv[i]) << "\"";
+    }
+    out << "],\"children\":[";
+    for (size_t i = 0; i < children.size(); ++i) {
+      const auto &child = children[i];
+      out << (i > 0 ? "," : "") << "{\"move\":\"" << Position(child.pos)
+          << "\",\"visits\":" << child.visits
+          << ",\"win_rate\":" << child.win_rate << "}";
+    }
+    out << "]}" << std::endl;
+  }
+
+  std::chrono::milliseconds elapsed{0};
+  size_t descents = 0, simulations = 0, reused = 0, depth_sum = 0;
+  size_t max_depth = 0, nodes = 0, bytes = 0;
+  // compactions of the tree into the spare arena
+  size_t collections = 0;
+  std::array<ThreadStats::clock::duration, ThreadStats::PHASES> phase_time{};
+  // proven win by the exact solver or the search, whose move starts the pv
+  bool solved = false;
+  std::vector<size_t> pv;
+  // most visited first
+  std::vector<Child> children;
+
+private:
+  const static constexpr std::array<const char *, ThreadStats::PHASES>
+      phase_names = {"selection", "expansion", "playout", "backprop"};
+};
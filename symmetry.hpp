@@ -0,0 +1,156 @@
+#pragma once
+#include "bitboard.hpp"
+#include "board.hpp"
+#include <array>
+#include <cstdint>
+#include <tuple>
+
+// The 8 symmetries of the board. Symmetry s transposes the board if s & 4,
+// then mirrors the columns if s & 1 and flips the rows if s & 2.
+namespace symmetry {
+
+constexpr Bitboard81 delta_swap(const Bitboard81 &b, const Bitboard81 &mask,
+                                size_t shift) noexcept {
+  const auto t = ((b >> shift) ^ b) & mask;
+  return b ^ t ^ (t << shift);
+}
+
+template <class F> constexpr Bitboard81 points_where(F &&f) noexcept {
+  Bitboard81 ret;
+  for (size_t p = 0; p < 81; ++p) {
+    if (f(p / 9, p % 9)) {
+      ret.set(p);
+    }
+  }
+  return ret;
+}
+
+// swap halves around the middle line, then pairs, then neighbours
+constexpr auto MIRROR_MASKS = std::array<Bitboard81, 3>{
+    points_where([](size_t, size_t c) { return c < 4; }),
+    points_where([](size_t, size_t c) { return c % 5 < 2; }),
+    points_where([](size_t, size_t c) { return c % 5 % 2 == 0 && c != 4; })};
+constexpr auto FLIP_MASKS = std::array<Bitboard81, 3>{
+    points_where([](size_t r, size_t) { return r < 4; }),
+    points_where([](size_t r, size_t) { return r % 5 < 2; }),
+    points_where([](size_t r, size_t) { return r % 5 % 2 == 0 && r != 4; })};
+// (r, c) with c - r = k swaps with (c, r), 8k points further
+constexpr auto TRANSPOSE_MASKS = []() constexpr {
+  std::array<Bitboard81, 9> ret{};
+  for (size_t k = 1; k < 9; ++k) {
+    ret[k] = points_where([k](size_t r, size_t c) { return c == r + k; });
+  }
+  return ret;
+}();
+
+constexpr Bitboard81 mirror(Bitboard81 b) noexcept {
+  b = delta_swap(b, MIRROR_MASKS[0], 5);
+  b = delta_swap(b, MIRROR_MASKS[1], 2);
+  return delta_swap(b, MIRROR_MASKS[2], 1);
+}
+constexpr Bitboard81 flip(Bitboard81 b) noexcept {
+  b = delta_swap(b, FLIP_MASKS[0], 45);
+  b = delta_swap(b, FLIP_MASKS[1], 18);
+  return delta_swap(b, FLIP_MASKS[2], 9);
+}
+constexpr Bitboard81 transpose(Bitboard81 b) noexcept {
+  for (size_t k = 1; k < 9; ++k) {
+    b = delta_swap(b, TRANSPOSE_MASKS[k], 8 * k);
+  }
+  return b;
+}
+
+constexpr Bitboard81 transform(Bitboard81 b, size_t s) noexcept {
+  if (s & 4) {
+    b = transpose(b);
+  }
+  if (s & 1) {
+    b = mirror(b);
+  }
+  if (s & 2) {
+    b = flip(b);
+  }
+  return b;
+}
+
+// POINTS[s][p] is the image of point p under symmetry s
+constexpr auto POINTS = []() constexpr {
+  std::array<std::array<uint8_t, 81>, 8> ret{};
+  for (size_t s = 0; s < 8; ++s) {
+    for (size_t p = 0; p < 81; ++p) {
+      ret[s][p] = static_cast<uint8_t>(
+          transform(Bitboard81::single(p), s).find_first());
+    }
+  }
+  return ret;
+}();
+constexpr auto INVERSE = []() constexpr {
+  std::array<size_t, 8> ret{};
+  for (size_t s = 0; s < 8; ++s) {
+    for (size_t t = 0; t < 8; ++t) {
+      if (POINTS[t][POINTS[s][1]] == 1 && POINTS[t][POINTS[s][9]] == 9) {
+        ret[s] = t;
+      }
+    }
+  }
+  return ret;
+}();
+// points whose image under symmetry s is a smaller point
+constexpr auto HIGHER = []() constexpr {
+  std::array<Bitboard81, 8> ret{};
+  for (size_t s = 0; s < 8; ++s) {
+    ret[s] = points_where(
+        [s](size_t r, size_t c) { return POINTS[s][r * 9 + c] < r * 9 + c; });
+  }
+  return ret;
+}();
+
+struct Canonical {
+  uint64_t key;
+  // the symmetry taking the board to its canonical form
+  size_t symmetry;
+};
+
+constexpr uint64_t mix(uint64_t z) noexcept {
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+// the canonical form is the symmetric board with the smallest stone words
+inline Canonical canonical(const Board &b) noexcept {
+  const auto &black = b.get_stones(0), &white = b.get_stones(1);
+  auto best = std::make_tuple(black.lo(), black.hi(), white.lo(), white.hi());
+  size_t best_symmetry = 0;
+  for (size_t s = 1; s < 8; ++s) {
+    const auto tb = transform(black, s), tw = transform(white, s);
+    const auto t = std::make_tuple(tb.lo(), tb.hi(), tw.lo(), tw.hi());
+    if (t < best) {
+      best = t;
+      best_symmetry = s;
+    }
+  }
+  const auto &[blo, bhi, wlo, whi] = best;
+  return {mix(blo ^ mix(bhi ^ mix(wlo ^ mix(whi)))), best_symmetry};
+}
+
+constexpr size_t to_canonical(size_t p, size_t s) noexcept {
+  return POINTS[s][p];
+}
+constexpr size_t from_canonical(size_t p, size_t s) noexcept {
+  return POINTS[INVERSE[s]][p];
+}
+
+// moves keeping one representative of each set of moves equivalent under
+// the symmetries of the position
+inline Bitboard81 unique_moves(const Board &b, Bitboard81 moves) noexcept {
+  const auto &black = b.get_stones(0), &white = b.get_stones(1);
+  for (size_t s = 1; s < 8; ++s) {
+    if (transform(black, s) == black && transform(white, s) == white) {
+      moves &= ~HIGHER[s];
+    }
+  }
+  return moves;
+}
+
+} // namespace symmetry
@@ -0,0 +1,81 @@
+#pragma once
+#include "board.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+
+// Per-move time budgets from GTP time_settings/time_left (Canadian byo-yomi,
+// sudden death when byo-yomi is absent).
+class TimeManager {
+public:
+  using duration = std::chrono::milliseconds;
+  const static constexpr auto margin = std::chrono::milliseconds(50);
+  const static constexpr auto min_budget = std::chrono::milliseconds(10);
+
+  void settings(duration main_time, duration byo_yomi_time,
+                size_t byo_yomi_stones) noexcept {
+    // GTP: byo-yomi time without stones means no time limit
+    enabled_ = !(byo_yomi_stones == 0 && byo_yomi_time > duration::zero());
+    main_time_ = main_time;
+    byo_yomi_time_ = byo_yomi_time;
+    byo_yomi_stones_ = byo_yomi_stones;
+    reset();
+  }
+
+  void left(size_t bw, duration time, size_t stones) noexcept {
+    clocks_[bw] = {time, stones};
+  }
+
+  void reset() noexcept {
+    for (auto &clock : clocks_) {
+      clock = main_time_ > duration::zero()
+                  ? Clock{main_time_, 0}
+                  : Clock{byo_yomi_time_, byo_yomi_stones_};
+    }
+  }
+
+  constexpr bool enabled() const noexcept { return enabled_; }
+
+  // spread the clock over the moves we still expect to play; a NoGo game
+  // rarely fills more than two thirds of the board
+  duration budget(const Board &b, size_t bw) const noexcept {
+    const auto &clock = clocks_[bw];
+    const size_t moves_left = std::max<size_t>(b.empty_count() / 3, 4);
+    duration budget;
+    if (clock.stones > 0) {
+      budget = clock.time / static_cast<long>(clock.stones);
+    } else {
+      budget = clock.time / static_cast<long>(moves_left);
+      if (byo_yomi_stones_ > 0) {
+        budget += byo_yomi_time_ / static_cast<long>(byo_yomi_stones_);
+      }
+    }
+    const auto limit = (clock.stones > 0 || byo_yomi_stones_ == 0)
+                           ? clock.time - margin
+                           : clock.time + byo_yomi_time_ - margin;
+    return std::max(std::min(budget - margin, limit), duration(min_budget));
+  }
+
+  // local bookkeeping for controllers which never send time_left
+  void spend(size_t bw, duration elapsed) noexcept {
+    auto &clock = clocks_[bw];
+    clock.time -= elapsed;
+    if (clock.stones == 0) {
+      if (clock.time < duration::zero() && byo_yomi_stones_ > 0) {
+        clock = {byo_yomi_time_ + clock.time, byo_yomi_stones_};
+      }
+    } else if (--clock.stones == 0) {
+      clock = {byo_yomi_time_, byo_yomi_stones_};
+    }
+  }
+
+private:
+  struct Clock {
+    duration time;
+    size_t stones;
+  };
+  bool enabled_ = false;
+  duration main_time_{}, byo_yomi_time_{};
+  size_t byo_yomi_stones_ = 0;
+  std::array<Clock, 2> clocks_{};
+};
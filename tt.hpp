@@ -0,0 +1,97 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Fixed-size table of search statistics shared by all tree nodes reaching
+// the same position. Buckets hold two entries; a new position replaces the
+// less visited one. Updates are lock-free, so a racing replacement may
+// blur the counts of one entry, which the search tolerates.
+class TranspositionTable {
+public:
+  // toggles the side that made the last move in a position key
+  static constexpr uint64_t side_key = 0x5bd1e9955bd1e995ull;
+
+  struct alignas(32) Entry {
+    std::atomic<uint64_t> key{0};
+    std::atomic<uint32_t> wins{0}, visits{0}, rave_wins{0}, rave_visits{0};
+  };
+
+  explicit TranspositionTable(size_t megabytes)
+      : size_(bucket_count(megabytes)),
+        buckets_(size_ > 0 ? std::make_unique<Bucket[]>(size_) : nullptr) {}
+
+  constexpr bool enabled() const noexcept { return size_ > 0; }
+
+  Entry *find(uint64_t key) const noexcept {
+    auto &bucket = buckets_[key & (size_ - 1)];
+    for (auto &entry : bucket.entries) {
+      if (entry.key.load(std::memory_order_relaxed) == key) {
+        return &entry;
+      }
+    }
+    return nullptr;
+  }
+
+  Entry *find_or_insert(uint64_t key) noexcept {
+    auto &bucket = buckets_[key & (size_ - 1)];
+    auto &e0 = bucket.entries[0], &e1 = bucket.entries[1];
+    for (;;) {
+      uint64_t k0 = e0.key.load(std::memory_order_relaxed),
+               k1 = e1.key.load(std::memory_order_relaxed);
+      if (k0 == key) {
+        return &e0;
+      }
+      if (k1 == key) {
+        return &e1;
+      }
+      auto &victim = e0.visits.load(std::memory_order_relaxed) <=
+                             e1.visits.load(std::memory_order_relaxed)
+                         ? e0
+                         : e1;
+      uint64_t old = &victim == &e0 ? k0 : k1;
+      if (victim.key.compare_exchange_strong(old, key,
+                                             std::memory_order_relaxed)) {
+        victim.wins.store(0, std::memory_order_relaxed);
+        victim.visits.store(0, std::memory_order_relaxed);
+        victim.rave_wins.store(0, std::memory_order_relaxed);
+        victim.rave_visits.store(0, std::memory_order_relaxed);
+        return &victim;
+      }
+    }
+  }
+
+  void clear() noexcept {
+    for (size_t i = 0; i < size_; ++i) {
+      for (auto &entry : buckets_[i].entries) {
+        entry.key.store(0, std::memory_order_relaxed);
+        entry.wins.store(0, std::memory_order_relaxed);
+        entry.visits.store(0, std::memory_order_relaxed);
+        entry.rave_wins.store(0, std::memory_order_relaxed);
+        entry.rave_visits.store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+
+private:
+  struct Bucket {
+    Entry entries[2];
+  };
+
+  // the largest power of two number of buckets that fits
+  static constexpr size_t bucket_count(size_t megabytes) noexcept {
+    const size_t buckets = megabytes * 1024 * 1024 / sizeof(Bucket);
+    if (buckets == 0) {
+      return 0;
+    }
+    size_t ret = 1;
+    while (ret * 2 <= buckets) {
+      ret *= 2;
+    }
+    return ret;
+  }
+
+  size_t size_;
+  std::unique_ptr<Bucket[]> buckets_;
+};
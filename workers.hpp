@@ -0,0 +1,228 @@
+#pragma once
+#include "agent.hpp"
+#include "board.hpp"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <type_traits>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+// Root-parallel search over worker processes. Each worker is a fork of this
+// process searching with an MCTSAgent of its own seed, and talks over a
+// Unix socket pair: it reads a Request, searches, and answers with the
+// visits of its root children, which the coordinator adds to its own. A
+// worker which dies is dropped without taking the others down.
+class WorkerPool {
+public:
+  using clock = std::chrono::steady_clock;
+
+  struct Request {
+    uint64_t id;
+    Board board;
+    uint64_t bw, budget_ms, min_simulations;
+  };
+  struct Reply {
+    uint64_t id;
+    // the move of the worker, proven to win when solved is set
+    uint32_t move, solved;
+    std::array<uint32_t, 81> visits;
+  };
+  static_assert(std::is_trivially_copyable_v<Request>);
+
+  // forks workers searching with config; call before any thread starts
+  WorkerPool(const MCTSConfig &config, size_t workers) {
+    for (size_t i = 0; i < workers; ++i) {
+      int fds[2];
+      if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        std::cerr << "cannot create the socket of worker " << i << std::endl;
+        break;
+      }
+      const pid_t pid = ::fork();
+      if (pid == 0) {
+        ::close(fds[0]);
+        // the sockets of the other workers are the coordinator's only
+        for (const auto &worker : workers_) {
+          ::close(worker.fd);
+        }
+        MCTSConfig worker_config(config);
+        worker_config.seed = config.seed + i + 1;
+        worker_config.ponder = false;
+        worker_config.verbose = false;
+        worker_config.log.clear();
+        serve(fds[1], worker_config);
+        ::_exit(0);
+      }
+      ::close(fds[1]);
+      if (pid < 0) {
+        ::close(fds[0]);
+        std::cerr << "cannot fork worker " << i << std::endl;
+        break;
+      }
+      workers_.push_back({fds[0], pid});
+    }
+  }
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+  ~WorkerPool() {
+    for (auto &worker : workers_) {
+      drop(worker);
+    }
+  }
+
+  // starts the search of b with bw to move on every worker, with the
+  // arguments of MCTSAgent::take_action
+  void start(const Board &b, size_t bw, std::chrono::milliseconds budget,
+             size_t min_simulations) {
+    Request request{};
+    request.id = ++id_;
+    request.board = b;
+    request.bw = bw;
+    request.budget_ms = static_cast<uint64_t>(budget.count());
+    request.min_simulations = min_simulations;
+    for (auto &worker : workers_) {
+      if (worker.fd >= 0 && transfer(worker.fd, &request, sizeof(request),
+                                     false, clock::time_point::max()) !=
+                                DONE) {
+        lose(worker);
+      }
+    }
+  }
+
+  // adds the visits of the root children of the workers to visits, waiting
+  // for them until deadline; returns the move of a worker which proved a
+  // win, or 81. Workers answering late are skipped this time.
+  size_t collect(std::unordered_map<size_t, size_t> &visits,
+                 clock::time_point deadline) {
+    size_t solved = 81;
+    for (auto &worker : workers_) {
+      if (worker.fd < 0) {
+        continue;
+      }
+      Reply reply{};
+      // answers to the searches skipped before come first
+      Status status;
+      do {
+        status = transfer(worker.fd, &reply, sizeof(reply), true, deadline);
+      } while (status == DONE && reply.id != id_);
+      if (status == CLOSED) {
+        lose(worker);
+      }
+      if (status != DONE) {
+        continue;
+      }
+      if (reply.solved != 0 && reply.move < 81) {
+        solved = reply.move;
+      }
+      for (size_t p = 0; p < 81; ++p) {
+        if (reply.visits[p] > 0) {
+          visits[p] += reply.visits[p];
+        }
+      }
+    }
+    return solved;
+  }
+
+private:
+  struct Worker {
+    int fd;
+    pid_t pid;
+  };
+  enum Status { DONE, LATE, CLOSED };
+
+  // the loop of a worker, until its socket closes
+  static void serve(int fd, const MCTSConfig &config) {
+    MCTSAgent agent(config);
+    Request request{};
+    while (transfer(fd, &request, sizeof(request), true,
+                    clock::time_point::max()) == DONE) {
+      const size_t move = agent.take_action(
+          request.board, request.bw,
+          std::chrono::milliseconds(
+              static_cast<std::chrono::milliseconds::rep>(request.budget_ms)),
+          request.min_simulations);
+      Reply reply{};
+      reply.id = request.id;
+      reply.move = static_cast<uint32_t>(move);
+      reply.solved = static_cast<uint32_t>(agent.get_stats().solved);
+      std::unordered_map<size_t, size_t> visits;
+      agent.get_children_visits(visits);
+      for (const auto &[pos, n] : visits) {
+        reply.visits[pos] = static_cast<uint32_t>(n);
+      }
+      if (transfer(fd, &reply, sizeof(reply), false,
+                   clock::time_point::max()) != DONE) {
+        break;
+      }
+    }
+    ::close(fd);
+  }
+
+  // reads or writes the size bytes at data; the deadline only holds until
+  // the first byte, so that a message is never cut in the middle
+  static Status transfer(int fd, void *data, size_t size, bool in,
+                         clock::time_point deadline) {
+    auto *bytes = static_cast<char *>(data);
+    for (size_t done = 0; done < size;) {
+      int timeout = -1;
+      if (done == 0 && deadline != clock::time_point::max()) {
+        const auto left =
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - clock::now());
+        timeout = static_cast<int>(std::max<int64_t>(left.count(), 0));
+      }
+      pollfd pfd{fd, static_cast<short>(in ? POLLIN : POLLOUT), 0};
+      const int ready = ::poll(&pfd, 1, timeout);
+      if (ready < 0 && errno == EINTR) {
+        continue;
+      }
+      if (ready == 0) {
+        return LATE;
+      }
+      if (ready < 0) {
+        return CLOSED;
+      }
+      // a closed peer must not raise SIGPIPE in the coordinator
+      const ssize_t n = in ? ::recv(fd, bytes + done, size - done, 0)
+                           : ::send(fd, bytes + done, size - done,
+                                    MSG_NOSIGNAL);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return CLOSED;
+      }
+      done += static_cast<size_t>(n);
+    }
+    return DONE;
+  }
+
+  void lose(Worker &worker) {
+    std::cerr << "worker " << worker.pid << " lost" << std::endl;
+    drop(worker);
+  }
+  // an idle worker exits when its socket closes, but a busy one would
+  // only notice after its search, so it is terminated
+  void drop(Worker &worker) noexcept {
+    if (worker.fd < 0) {
+      return;
+    }
+    ::close(worker.fd);
+    worker.fd = -1;
+    ::kill(worker.pid, SIGTERM);
+    ::waitpid(worker.pid, nullptr, 0);
+  }
+
+  std::vector<Worker> workers_;
+  uint64_t id_ = 0;
+};